@@ -4,11 +4,350 @@
  * AS32-TTL-100.
  */
 
+#include <poll.h>    // For poll().
+#include <time.h>    // For clock_gettime().
 #include "as32_config.h"
 
+// Counters of the commands sent by this thread, so that
+// modules configured by several threads are not mixed up.
+static __thread as32_stats stats;
+
+/** \fn int as32_air_rate(int speed)
+ *
+ * Get the air data rate selected by a SPEED parameter.
+ * \param speed The SPEED parameter, e.g., SPEED.
+ * \return Returns the air data rate in bps.
+ */
+int as32_air_rate(int speed) {
+    // Air rates of the low 3 bits, 0.3k to 19.2k bps. The
+    // last three values all select 19.2k bps.
+    static const int rates[8] = {
+        300, 1200, 2400, 4800, 9600, 19200, 19200, 19200
+    };
+    return rates[speed & AIR_RATE_MASK];
+}
+
+// LoRa spreading factors and bandwidths in kHz of the air
+// rates. They are not published; each is the setting whose
+// bit rate is the nearest to the air rate, with coding rate
+// 4/5, e.g., SF11 at 500 kHz is 2148 bps for 2.4k bps.
+static const int spreading[8] = { 12, 11, 11, 7, 7, 7, 7, 7 };
+static const int bandwidths[8] = { 125, 250, 500, 125, 250, 500, 500, 500 };
+
+/** \fn int64_t as32_time_on_air(int speed, int len)
+ *
+ * Get the time a packet stays on the air, by the formula
+ * of the Semtech SX127x datasheet with an explicit header
+ * and a CRC.
+ * \param speed The SPEED parameter, e.g., SPEED.
+ * \param len The bytes of the packet, at most the sub
+ *        packet of the module.
+ * \return Returns the time on air in nanoseconds.
+ */
+int64_t as32_time_on_air(int speed, int len) {
+    int sf = spreading[speed & AIR_RATE_MASK];
+    int64_t symbol = (1000000LL << sf) / bandwidths[speed & AIR_RATE_MASK];
+    // Symbols longer than 16 ms are sent with low data rate
+    // optimization, i.e., 2 bits less each.
+    int bits = 4 * (sf - (symbol > 16000000 ? 2 : 0));
+    int payload = 8 * len - 4 * sf + 28 + 16, symbols = 8;
+
+    if (payload > 0)
+        symbols += (payload + bits - 1) / bits * (4 + AS32_CODING);
+    // The preamble takes 4.25 symbols more than programmed.
+    return symbol * (4 * AS32_PREAMBLE + 17) / 4 + symbol * symbols;
+}
+
+/** \fn static int64_t now_us(void)
+ *
+ * Get the time on CLOCK_MONOTONIC in microseconds.
+ */
+static int64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/** \fn int as32_command(int spfd, const unsigned char *cmd, int len, unsigned char *answer, int min, int max)
+ *
+ * Send a command to a LoRa module and wait for its answer,
+ * without ever blocking in read(). A try waits until max
+ * bytes are received, or at least min bytes followed by
+ * AS32_IDLE ms of silence. A try that times out is sent
+ * again, up to AS32_RETRIES times, waiting twice as long
+ * each time.
+ * \param spfd The descriptior of a open serial port which 
+ *        communicates with the LoRa module.
+ * \param cmd The command, which is written at once.
+ * \param len The command length.
+ * \param answer Where to store the answer.
+ * \param min The shortest answer.
+ * \param max The longest answer.
+ * \return Returns -1 on error or if no try was answered,
+ *         or the answer length.
+ */
+int as32_command(int spfd, const unsigned char *cmd, int len,
+    unsigned char *answer, int min, int max) {
+    struct pollfd pfd;
+    int64_t sent, last = 0, deadline, now;
+    int timeout = AS32_TIMEOUT, got, n, wait;
+
+    pfd.fd = spfd;
+    pfd.events = POLLIN;
+    stats.commands++;
+    for (int try = 0; try <= AS32_RETRIES; try++, timeout *= 2) {
+        if (try > 0)
+            stats.retries++;
+        // Bytes received before the answer would be taken
+        // for it.
+        tcflush(spfd, TCIFLUSH);
+        if (write_all(spfd, cmd, len) < 0)
+            return ERROR;
+        sent = now_us();
+        deadline = sent + timeout * 1000LL;
+        got = 0;
+        while (got < max && (now = now_us()) < deadline) {
+            wait = (deadline - now + 999) / 1000;
+            if (got >= min && wait > AS32_IDLE)
+                wait = AS32_IDLE;
+            if ((n = poll(&pfd, 1, wait)) < 0 && errno != EINTR)
+                return ERROR;
+            if (n == 0 && got >= min)
+                break;
+            if (n <= 0)
+                continue;
+            if ((n = read(spfd, answer + got, max - got)) < 0 &&
+                errno != EINTR && errno != EAGAIN)
+                return ERROR;
+            if (n == 0)
+                return ERROR;
+            if (n > 0) {
+                got += n;
+                last = now_us();
+            }
+        }
+        if (got >= min) {
+            stats.answered++;
+            stats.last = last - sent;
+            stats.sum += stats.last;
+            if (stats.last > stats.max)
+                stats.max = stats.last;
+            return got;
+        }
+        stats.timeouts++;
+    }
+    return ERROR;
+}
+
+/** \fn const as32_stats *get_as32_stats(void)
+ *
+ * Get the counters of the commands sent by this thread.
+ */
+const as32_stats *get_as32_stats(void) {
+    return &stats;
+}
+
+/** \fn void print_as32_stats(void)
+ *
+ * Print the counters of the commands sent by this thread.
+ */
+void print_as32_stats(void) {
+    print_msg("AS32: %lu commands, %lu answered, %lu retries, %lu timeouts, "
+              "response time: last %.2lf ms, mean %.2lf ms, max %.2lf ms.",
+        stats.commands, stats.answered, stats.retries, stats.timeouts,
+        stats.last / 1e3,
+        stats.answered ? stats.sum / 1e3 / stats.answered : 0.0,
+        stats.max / 1e3);
+}
+
+// UART rates of bits 3 to 5 of SPEED.
+static const int bauds[8] = {
+    1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200
+};
+// Transmit powers of bits 0 and 1 of OPTION.
+static const int powers[4] = { 20, 17, 14, 10 };
+
+/** \fn static int find_code(const int *values, int n, int value)
+ *
+ * Get the code of a value in a table of values.
+ * \return Returns -1 if the value has no code, or the
+ *         first code of the value.
+ */
+static int find_code(const int *values, int n, int value) {
+    for (int i = 0; i < n; i++)
+        if (values[i] == value)
+            return i;
+    return ERROR;
+}
+
+/** \fn int encode_as32_param(const as32_param *p, int persist_or_temporary, unsigned char cmd[])
+ *
+ * Encode parameters as a parameter command.
+ * \param p The parameters.
+ * \param persist_or_temporary PERSIST or TEMPORARY.
+ * \param cmd Where to store the PARAM_SIZE bytes of the
+ *        command.
+ * \return Returns -1 if a field has no code, 0 otherwise.
+ */
+int encode_as32_param(const as32_param *p, int persist_or_temporary,
+    unsigned char cmd[]) {
+    static const int rates[6] = { 300, 1200, 2400, 4800, 9600, 19200 };
+    int baud, air, power;
+
+    if ((baud = find_code(bauds, 8, p->baud)) < 0 ||
+        (air = find_code(rates, 6, p->air_rate)) < 0 ||
+        (power = find_code(powers, 4, p->power)) < 0 ||
+        p->addr < 0 || p->addr > 0xffff ||
+        p->chan < 0 || p->chan > MAX_CHAN ||
+        p->parity < PARITY_8N1 || p->parity > PARITY_8E1 ||
+        p->wake_time < 250 || p->wake_time > 2000 || p->wake_time % 250)
+        return ERROR;
+    cmd[0] = persist_or_temporary == PERSIST ? PERSIST_CMD : TEMP_CMD;
+    cmd[1] = p->addr >> 8;
+    cmd[2] = p->addr & 0xff;
+    cmd[3] = p->parity << PARITY_SHIFT | baud << BAUD_SHIFT | air;
+    cmd[4] = p->chan;
+    cmd[5] = (p->fixed ? FIXED_BIT : 0) | (p->push_pull ? PUSH_PULL_BIT : 0) |
+        (p->wake_time / 250 - 1) << WAKE_SHIFT | (p->fec ? FEC_BIT : 0) |
+        power;
+    return OK;
+}
+
+/** \fn int decode_as32_param(const unsigned char cmd[], as32_param *p)
+ *
+ * Decode a parameter command, or the answer of a module
+ * to read_as32_param().
+ * \param cmd The PARAM_SIZE bytes.
+ * \param p Where to store the parameters.
+ * \return Returns -1 if the head is not PERSIST_CMD or
+ *         TEMP_CMD, 0 otherwise.
+ */
+int decode_as32_param(const unsigned char cmd[], as32_param *p) {
+    if (cmd[0] != PERSIST_CMD && cmd[0] != TEMP_CMD)
+        return ERROR;
+    p->addr = cmd[1] << 8 | cmd[2];
+    // Parity 3 is 8N1 as well.
+    p->parity = (cmd[3] >> PARITY_SHIFT) % 3;
+    p->baud = bauds[(cmd[3] >> BAUD_SHIFT) & 0x07];
+    p->air_rate = as32_air_rate(cmd[3]);
+    p->chan = cmd[4] & MAX_CHAN;
+    p->fixed = (cmd[5] & FIXED_BIT) != 0;
+    p->push_pull = (cmd[5] & PUSH_PULL_BIT) != 0;
+    p->wake_time = (((cmd[5] >> WAKE_SHIFT) & 0x07) + 1) * 250;
+    p->fec = (cmd[5] & FEC_BIT) != 0;
+    p->power = powers[cmd[5] & POWER_MASK];
+    return OK;
+}
+
+/** \fn int equal_as32_param(const as32_param *a, const as32_param *b)
+ *
+ * Tell whether two sets of decoded parameters are the
+ * same. Bytes that differ may encode the same parameters,
+ * e.g., air rate codes 5 to 7, or parity 3 and 0.
+ * \return Returns TRUE if they are, FALSE otherwise.
+ */
+int equal_as32_param(const as32_param *a, const as32_param *b) {
+    return a->addr == b->addr && a->parity == b->parity &&
+        a->baud == b->baud && a->air_rate == b->air_rate &&
+        a->chan == b->chan && a->fixed == b->fixed &&
+        a->push_pull == b->push_pull && a->wake_time == b->wake_time &&
+        a->fec == b->fec && a->power == b->power;
+}
+
+/** \fn void default_as32_param(as32_param *p)
+ *
+ * Get the parameters of ADDH, ADDL, SPEED, CHAN and OPTION.
+ */
+void default_as32_param(as32_param *p) {
+    const unsigned char cmd[PARAM_SIZE] = {
+        PERSIST_CMD, ADDH, ADDL, SPEED, CHAN, OPTION
+    };
+
+    decode_as32_param(cmd, p);
+}
+
+/** \fn int write_as32_param(int spfd, const as32_param *p, int persist_or_temporary)
+ *
+ * Write parameters to a LoRa module, which should be in
+ * its configuration mode.
+ * \param spfd The descriptior of a open serial port which 
+ *        communicates with the LoRa module.
+ * \param p The parameters.
+ * \param persist_or_temporary PERSIST or TEMPORARY.
+ * \return Returns 0 on success, -1 on failure.
+ */
+int write_as32_param(int spfd, const as32_param *p, int persist_or_temporary) {
+    unsigned char cmd[PARAM_SIZE];
+
+    if (encode_as32_param(p, persist_or_temporary, cmd) < 0)
+        return ERROR;
+    // The command should be written at once, see
+    // read_as32_param().
+    if (write(spfd, cmd, PARAM_SIZE) != PARAM_SIZE)
+        return ERROR;
+    return OK;
+}
+
+/** \fn int configure_as32(int spfd, const as32_param *want, int persist_or_temporary)
+ *
+ * Bring a LoRa module to given parameters: read the
+ * parameters in use, and write and read them back only if
+ * they differ, so that a module already configured, e.g.,
+ * on a restart, is left as it is.
+ * \param spfd The descriptior of a open serial port which 
+ *        communicates with the LoRa module.
+ * \param want The parameters.
+ * \param persist_or_temporary PERSIST or TEMPORARY.
+ * \return Returns -1 on error or if the module does not
+ *         take the parameters, 0 if the module had them
+ *         already, 1 if they were written.
+ */
+int configure_as32(int spfd, const as32_param *want, int persist_or_temporary) {
+    unsigned char want_cmd[PARAM_SIZE], cmd[PARAM_SIZE];
+    as32_param wanted, got;
+
+    if (encode_as32_param(want, persist_or_temporary, want_cmd) < 0)
+        return ERROR;
+    // The parameters are compared decoded, as the module
+    // may hold other bytes for the same ones.
+    decode_as32_param(want_cmd, &wanted);
+    if (read_as32_param(spfd, (char *)cmd) < 0 ||
+        decode_as32_param(cmd, &got) < 0)
+        return ERROR;
+    if (equal_as32_param(&got, &wanted))
+        return 0;
+    if (write(spfd, want_cmd, PARAM_SIZE) != PARAM_SIZE)
+        return ERROR;
+    // A command sent at once after would be taken along
+    // with the parameters.
+    tcdrain(spfd);
+    usleep(AS32_SETTLE * 1000);
+    if (read_as32_param(spfd, (char *)cmd) < 0 ||
+        decode_as32_param(cmd, &got) < 0 || !equal_as32_param(&got, &wanted))
+        return ERROR;
+    return 1;
+}
+
+/** \fn void print_as32_param(const as32_param *p)
+ *
+ * Print the parameters of a LoRa module.
+ */
+void print_as32_param(const as32_param *p) {
+    static const char *parities[3] = { "8N1", "8O1", "8E1" };
+
+    print_msg("address 0x%04x, channel %d (%d MHz), UART %d bps %s, "
+              "air %d bps, %s, %s, wake up %d ms, FEC %s, %d dBm.",
+        p->addr, p->chan, 410 + p->chan, p->baud, parities[p->parity],
+        p->air_rate, p->fixed ? "fixed point" : "transparent",
+        p->push_pull ? "push-pull" : "open drain", p->wake_time,
+        p->fec ? "on" : "off", p->power);
+}
+
 /** \fn int set_transmit_param(int spfd, int persist_or_temporary)
  *
- * Set the transmit parameters of LoRa module.
+ * Set the transmit parameters of LoRa module to ADDH,
+ * ADDL, SPEED, CHAN and OPTION.
  *
  * \param spfd The descriptior of a open serial port which 
  *        communicates with the LoRa module.
@@ -18,31 +357,32 @@
  * \return Returns 0 on success, -1 on failure.
  */
 int set_transmit_param(int spfd, int persist_or_temporary) {
-    char cmd[6];
-    memset(cmd, 0, 6 * sizeof(char));
+    as32_param p;
 
-    // Records the configuration command in a buffer.
-    if (persist_or_temporary == PERSIST) {
-        print_msg("persist");
-        cmd[0] = 0xc0;
-    }
-    else {
-        print_msg("temporary");
-        cmd[0] = 0xc2;
-    }
-    cmd[1] = 0x56;
-    cmd[2] = 0x78;
-    cmd[3] = 0x1a;
-    cmd[4] = 0x17;
-    cmd[5] = 0xc4;
-
-    for (int i = 0; i < 6; i++)
-        print_msg("0x%x", cmd[i]);
-
-    // Write the command to LoRa module.
-    if (write(spfd, cmd, 6) < 0)
-        error_dump("fail to write command.");
-    return OK;
+    default_as32_param(&p);
+    return write_as32_param(spfd, &p, persist_or_temporary);
+}
+
+/** \fn int set_as32_channel(int spfd, int chan, int persist_or_temporary)
+ *
+ * Move a LoRa module to another channel, keeping the
+ * other parameters at ADDH, ADDL, SPEED and OPTION. The
+ * module should be in its configuration mode.
+ *
+ * \param spfd The descriptior of a open serial port which 
+ *        communicates with the LoRa module.
+ * \param chan The channel, 0 to MAX_CHAN.
+ * \param persist_or_temporary Flag denoting whether the
+ *        channel is permanently or temporarily written to
+ *        the LoRa module.
+ * \return Returns 0 on success, -1 on failure.
+ */
+int set_as32_channel(int spfd, int chan, int persist_or_temporary) {
+    as32_param p;
+
+    default_as32_param(&p);
+    p.chan = chan;
+    return write_as32_param(spfd, &p, persist_or_temporary);
 }
 
 /** \fn int clear_line_feed(int spfd)
@@ -71,25 +411,18 @@ int clear_line_feed(int spfd) {
 
 /** \fn int reset_as32(int spfd)
  *
- * Reset the LoRa module.
+ * Reset the LoRa module, which does not answer.
  *
  * \param spfd The descriptior of a open serial port which 
  *        communicates with the LoRa module.
  * \return Returns 0 on success, -1 on error.
  */
 int reset_as32(int spfd) {
-    char cmd[3];
-    memset(cmd, 0, 3 * sizeof(char));
-    cmd[0] = 0xc4;
-    cmd[1] = 0xc4;
-    cmd[2] = 0xc4;
-
-    for (int i = 0; i < 3; i++)
-        printf("0x%x ", cmd[i]);
-    printf("\n");
-
-    if (write(spfd, cmd, 3) < 0)
-        error_dump("fail to write command.");
+    const unsigned char cmd[3] = { 0xc4, 0xc4, 0xc4 };
+
+    stats.commands++;
+    if (write_all(spfd, cmd, 3) < 0)
+        return ERROR;
     return OK;
 }
 
@@ -100,26 +433,18 @@ int reset_as32(int spfd) {
  * \param spfd The descriptior of a open serial port which 
  *        communicates with the LoRa module.
  * \param version The buffer provided by user to hold the
- *        string representing the module version.
+ *        string representing the module version, of
+ *        VERSION_SIZE bytes.
  * \return Returns the length of version string on success,
  *         -1 on error.
  */
 int read_as32_version(int spfd, char version[]) {
-    char cmd[3];
-    int i;
-    memset(cmd, 0, 3 * sizeof(char));
-    cmd[0] = 0xc3;
-    cmd[1] = 0xc3;
-    cmd[2] = 0xc3;
+    const unsigned char cmd[3] = { 0xc3, 0xc3, 0xc3 };
 
-    if (write(spfd, cmd, 3) < 0)
-        error_dump("fail to write command.");
-    print_msg("begin reading");
-    for (i = 0; i < 16; i++)
-        if (read(spfd, version + i, 1) < 0)
-            error_dump("fail to read parameters.");
-
-    return i - 1;
+    // The length of the answer differs between firmwares,
+    // so it ends at a pause.
+    return as32_command(spfd, cmd, 3, (unsigned char *)version, 1,
+        VERSION_SIZE);
 }
 
 /** \fn int read_as32_param(int spfd, char param[])
@@ -130,36 +455,20 @@ int read_as32_version(int spfd, char version[]) {
  *        communicates with the LoRa module.
  * \param param The buffer provided by user to hold the 
  *        configuration of the given LoRa module.
- * \return Returns the number of bytes presenting the configuration
+ * \return Returns -1 if the module does not answer, or the
+ *         number of bytes presenting the configuration
  *         of the given LoRa module in the param buffer.
  */
 int read_as32_param(int spfd, char param[]) {
-    char cmd[3];
-    int i;
-
-    memset(cmd, 0, 3 * sizeof(char));
-
-    cmd[0] = 0xc1;
-    cmd[1] = 0xc1;
-    cmd[2] = 0xc1;
+    const unsigned char cmd[3] = { 0xc1, 0xc1, 0xc1 };
 
     /*
      * Be aware of that when write command to the lora module,
-     * the command codes should be written at once, i.e., the
-     * VMIN parameter of serial port should be set equal to the length
-     * of command. For example, to gain the current configuration,
-     * we should send the command 0xc1 0xc1 0xc1, and the VMIN should
-     * be set as 3.
+     * the command codes should be written at once, which
+     * as32_command() does.
      * Furthermore, the serial port should have a baud rate of 
      * 9600 and 8-bit data, and no parity checks should be enabled.
      */
-    sleep(1);
-    if (write(spfd, cmd, 3) < 0)
-        error_dump("fail to write command.");
-    for (int i = 0; i < 6; i++) {
-        if (read(spfd, param + i, 1) < 0)
-            error_dump("fail to read parameters.");
-    }
-
-    return i - 1;
-}
\ No newline at end of file
+    return as32_command(spfd, cmd, 3, (unsigned char *)param, PARAM_SIZE,
+        PARAM_SIZE);
+}
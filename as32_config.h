@@ -10,7 +10,10 @@
 #include <unistd.h>  // For read, write, and sleep.
 #include <fcntl.h>   // For file and directory operations.
 #include <string.h>  // memset().
+#include <stdint.h>  // For fixed width integers.
+#include <termios.h> // For tcflush().
 #include "header.h"  // Message output.
+#include "io_ops.h"  // write_all().
 
 #define ADDH          0x00    //< The higher address of this module.
 #define ADDL          0x01    //< The lower address of this module.
@@ -32,10 +35,95 @@
 #define PERSIST       0       //< Denoting a persist command.
 #define TEMPORARY     1       // Denoting a temporary command.
 
+#define AIR_RATE_MASK 0x07    //< Air rate bits of SPEED.
+#define MAX_CHAN      0x1f    //< The highest channel, 410 + 31 MHz.
+#define PARAM_SIZE    6       //< Bytes of a parameter command or answer.
+#define VERSION_SIZE  16      //< The longest version answer read.
+
+// Waiting for answers of a module.
+#define AS32_TIMEOUT  100     //< Milliseconds for an answer on the first try.
+#define AS32_RETRIES  3       /*< Tries after the first one, each waiting
+                               * twice as long as the one before.
+                               */
+#define AS32_IDLE     20      /*< Milliseconds of silence that end an
+                               * answer of variable length.
+                               */
+#define AS32_SETTLE   50      /*< Milliseconds for a module to take
+                               * parameters written, before the next
+                               * command.
+                               */
+
+// The buffer and the LoRa packets of a module, for the
+// time on the air.
+#define AS32_BUFFER_SIZE 512  //< Bytes buffered by a module for the air.
+#define AS32_PREAMBLE 8       //< Programmed preamble symbols of a LoRa packet.
+#define AS32_CODING   1       //< LoRa coding rate 4/(4 + AS32_CODING).
+
+// Fields of SPEED and OPTION.
+#define PARITY_SHIFT  6       //< Parity in bits 6 and 7 of SPEED.
+#define BAUD_SHIFT    3       //< UART rate in bits 3 to 5 of SPEED.
+#define FIXED_BIT     0x80    //< Fixed point transmission in OPTION.
+#define PUSH_PULL_BIT 0x40    //< Push-pull IO drive in OPTION.
+#define WAKE_SHIFT    3       //< Wake up time in bits 3 to 5 of OPTION.
+#define FEC_BIT       0x04    //< FEC in OPTION.
+#define POWER_MASK    0x03    //< Transmit power in bits 0 and 1 of OPTION.
+
+// Parities of the UART.
+#define PARITY_8N1    0       //< 8 data bits, no parity, 1 stop bit.
+#define PARITY_8O1    1       //< Odd parity.
+#define PARITY_8E1    2       //< Even parity.
+
+/** \typedef as32_param
+ * The parameters of a LoRa module, field by field, as
+ * encoded in the 5 bytes after the head of a parameter
+ * command.
+ */
+typedef struct {
+    int addr;        /**< Module address, ADDH and ADDL */
+    int parity;      /**< PARITY_8N1, PARITY_8O1 or PARITY_8E1 */
+    int baud;        /**< UART rate in bps, 1200 to 115200 */
+    int air_rate;    /**< Air data rate in bps, 300 to 19200 */
+    int chan;        /**< Channel, 0 to MAX_CHAN */
+    int fixed;       /**< TRUE for fixed point transmission,
+                          FALSE for transparent transmission */
+    int push_pull;   /**< TRUE for push-pull IO drive, FALSE
+                          for open drain */
+    int wake_time;   /**< Wake up time in ms, 250 to 2000 */
+    int fec;         /**< TRUE if FEC is on */
+    int power;       /**< Transmit power in dBm, 20, 17, 14 or 10 */
+} as32_param;
+
+/** \typedef as32_stats
+ * Counters of the commands sent to LoRa modules by a
+ * thread, and of the response times of the modules.
+ */
+typedef struct {
+    unsigned long commands;  /**< Commands sent */
+    unsigned long answered;  /**< Commands answered */
+    unsigned long retries;   /**< Commands sent again */
+    unsigned long timeouts;  /**< Tries without a whole answer */
+    int64_t       last;      /**< The last response time in us */
+    int64_t       sum;       /**< Sum of response times */
+    int64_t       max;       /**< The longest response time */
+} as32_stats;
+
+int as32_air_rate(int);
+int64_t as32_time_on_air(int, int);
+int as32_command(int, const unsigned char *, int, unsigned char *, int, int);
+const as32_stats *get_as32_stats(void);
+void print_as32_stats(void);
+int encode_as32_param(const as32_param *, int, unsigned char []);
+int decode_as32_param(const unsigned char [], as32_param *);
+int equal_as32_param(const as32_param *, const as32_param *);
+void default_as32_param(as32_param *);
+int write_as32_param(int, const as32_param *, int);
+int configure_as32(int, const as32_param *, int);
+void print_as32_param(const as32_param *);
 int read_as32_param(int, char []);
 int read_as32_version(int, char []);
 int clear_line_feed(int);
 int reset_as32(int);
 int set_transmit_param(int, int);
+int set_as32_channel(int, int, int);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,395 @@
+/** \file as32_sim.c
+ *
+ * A simulator of AS32-TTL-100 modules and GPS modules on
+ * pseudo terminals, so that the sender and the receiver run
+ * unchanged without any hardware.
+ *
+ * Each simulated LoRa module is the slave side of a pty.
+ * Bytes written by the host are buffered as in the module,
+ * up to SIM_BUFFER_SIZE bytes, and sent on the air in
+ * packets of at most SIM_SUB_PACKET bytes, each taking
+ * its time on air at the air rate of the SPEED parameter,
+ * see as32_time_on_air().
+ * A packet is heard by every other module on the same
+ * channel and air rate, as in transparent mode, unless it
+ * is lost at random or overlaps a packet of another
+ * module.
+ *
+ * A write of exactly a command, i.e., 0xc1 0xc1 0xc1,
+ * 0xc3 0xc3 0xc3, 0xc4 0xc4 0xc4, or 0xc0 or 0xc2 followed
+ * by 5 parameters, is taken as a command, since the module
+ * takes a command written at once, see read_as32_param().
+ *
+ * Each module has a GPS pty next to it, streaming the
+ * epochs of an NMEA log, i.e., the sentences from a GGA
+ * sentence to the next, at a given rate.
+ */
+
+#define _GNU_SOURCE        // For posix_openpt(), ptsname().
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include "as32_sim.h"
+
+/** \fn static int64_t now_ns(void)
+ *
+ * Get the time on CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** \fn static int sim_open_pty(int *master, int *slave, char *name, int size)
+ *
+ * Open a pty. The slave side is held open, so that the
+ * master side is not hung up while the host has not opened
+ * it, and is left at its default termios, as a USB serial
+ * port is when plugged in, so that the port setup of the
+ * host is tested too, e.g., a CR translated to NL.
+ * \param master Where to store the master side, which is
+ *        non-blocking.
+ * \param slave Where to store the slave side.
+ * \param name Where to store the slave name.
+ * \param size The size of name.
+ * \return Returns -1 on error, 0 on success.
+ */
+static int sim_open_pty(int *master, int *slave, char *name, int size) {
+    char *path;
+
+    if ((*master = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+        return ERROR;
+    if (grantpt(*master) < 0 || unlockpt(*master) < 0 ||
+        (path = ptsname(*master)) == NULL || (int)strlen(path) >= size)
+        return ERROR;
+    strcpy(name, path);
+    if ((*slave = open(name, O_RDWR | O_NOCTTY)) < 0)
+        return ERROR;
+    return set_nonblock(*master);
+}
+
+/** \fn static int sim_command(sim_module *m, const unsigned char *p, int n)
+ *
+ * Answer a command written by the host.
+ * \param m The module.
+ * \param p The bytes written at once.
+ * \param n The number of bytes.
+ * \return Returns TRUE if the bytes are a command, FALSE
+ *         if they are data.
+ */
+static int sim_command(sim_module *m, const unsigned char *p, int n) {
+    if (n == 3 && p[0] == p[1] && p[1] == p[2]) {
+        switch (p[0]) {
+            case SIM_READ_CMD:
+                m->param[0] = PERSIST_CMD;
+                if (write(m->fd, m->param, 6) != 6)
+                    m->c.unread += 6;
+                break;
+            case SIM_VERSION_CMD:
+                if (write(m->fd, SIM_VERSION, 16) != 16)
+                    m->c.unread += 16;
+                break;
+            case SIM_RESET_CMD:
+                // Temporary parameters are lost, and so are
+                // the bytes waiting for the air.
+                memcpy(m->param, m->saved, 6);
+                m->count = 0;
+                break;
+            default:
+                return FALSE;
+        }
+        m->c.commands++;
+        return TRUE;
+    }
+    if (n == 6 && (p[0] == PERSIST_CMD || p[0] == TEMP_CMD)) {
+        memcpy(m->param, p, 6);
+        if (p[0] == PERSIST_CMD)
+            memcpy(m->saved, p, 6);
+        m->c.commands++;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/** \fn static void sim_host_input(sim_module *m, int64_t now)
+ *
+ * Take the bytes written by the host into the buffer of
+ * the module, or answer them if they are a command.
+ * \param m The module.
+ * \param now The current time in ns.
+ */
+static void sim_host_input(sim_module *m, int64_t now) {
+    unsigned char chunk[SIM_BUFFER_SIZE];
+    int n, i;
+
+    while ((n = read(m->fd, chunk, sizeof(chunk))) > 0) {
+        if (sim_command(m, chunk, n))
+            continue;
+        m->c.bytes_in += n;
+        for (i = 0; i < n && m->count < SIM_BUFFER_SIZE; i++, m->count++)
+            m->buf[(m->head + m->count) % SIM_BUFFER_SIZE] = chunk[i];
+        m->c.overflow += n - i;
+    }
+    if (m->air_len == 0 && m->count > 0)
+        sim_start_packet(m, now);
+}
+
+/** \fn static void sim_start_packet(sim_module *m, int64_t now)
+ *
+ * Put the next packet of a module on the air.
+ * \param m The module.
+ * \param now When the packet starts, in ns.
+ */
+static void sim_start_packet(sim_module *m, int64_t now) {
+    int len = m->count < SIM_SUB_PACKET ? m->count : SIM_SUB_PACKET;
+
+    for (int i = 0; i < len; i++)
+        m->air[i] = m->buf[(m->head + i) % SIM_BUFFER_SIZE];
+    m->head = (m->head + len) % SIM_BUFFER_SIZE;
+    m->count -= len;
+    m->air_len = len;
+    m->air_start = now;
+    m->air_end = now + as32_time_on_air(m->param[3], len);
+}
+
+/** \fn static int sim_hears(const sim_module *a, const sim_module *b)
+ *
+ * Tell whether two modules hear each other, i.e., are on
+ * the same channel and air rate.
+ */
+static int sim_hears(const sim_module *a, const sim_module *b) {
+    return (a->param[4] & MAX_CHAN) == (b->param[4] & MAX_CHAN) &&
+        as32_air_rate(a->param[3]) == as32_air_rate(b->param[3]);
+}
+
+/** \fn static void sim_end_packet(sim_module *m, int64_t now)
+ *
+ * Deliver the packet of a module at the end of its air
+ * time, and start the next one.
+ * \param m The module.
+ * \param now The current time in ns.
+ */
+static void sim_end_packet(sim_module *m, int64_t now) {
+    sim_module *o;
+    int collided = FALSE, n;
+
+    // Another packet on the channel during this one, still
+    // on the air or just over, spoils both.
+    for (o = modules; o < modules + nmodules; o++)
+        if (o != m && sim_hears(o, m) &&
+            ((o->air_len > 0 && o->air_start < m->air_end) ||
+             (o->last_end > m->air_start && o->last_start < m->air_end)))
+            collided = TRUE;
+    m->c.packets++;
+    m->c.air_bytes += m->air_len;
+    for (o = modules; o < modules + nmodules; o++) {
+        if (o == m || !sim_hears(o, m))
+            continue;
+        if (collided) {
+            o->c.collided++;
+            continue;
+        }
+        if (rand() < loss / 100 * ((double)RAND_MAX + 1)) {
+            o->c.lost++;
+            continue;
+        }
+        o->c.received++;
+        if ((n = write(o->fd, m->air, m->air_len)) < m->air_len)
+            o->c.unread += m->air_len - (n > 0 ? n : 0);
+    }
+    m->last_start = m->air_start;
+    m->last_end = m->air_end;
+    m->air_len = 0;
+    // The next packet follows right after this one.
+    if (m->count > 0)
+        sim_start_packet(m, m->air_end < now ? m->air_end : now);
+}
+
+/** \fn static void sim_report(double seconds)
+ *
+ * Print the counters of every module.
+ * \param seconds The time since the simulation started.
+ */
+static void sim_report(double seconds) {
+    sim_module *m;
+
+    for (m = modules; m < modules + nmodules; m++)
+        print_msg("%s: chan %d, %d bps, %lu bytes in, %lu overflow, "
+                  "%lu packets (%.1lf B/s), %lu received, %lu lost, "
+                  "%lu collided, %lu unread, %lu commands.",
+            m->name, m->param[4] & MAX_CHAN, as32_air_rate(m->param[3]),
+            m->c.bytes_in, m->c.overflow, m->c.packets,
+            seconds > 0 ? m->c.air_bytes / seconds : 0.0, m->c.received,
+            m->c.lost, m->c.collided, m->c.unread, m->c.commands);
+    fflush(stdout);
+}
+
+/** \fn static char *load_nmea(const char *path, int **epochs, int *nepochs)
+ *
+ * Load an NMEA log and find the start of each epoch.
+ * \param path The log.
+ * \param epochs Where to store the offsets of the epochs,
+ *        followed by the end of the log.
+ * \param nepochs Where to store the number of epochs.
+ * \return Returns the log, exits on error.
+ */
+static char *load_nmea(const char *path, int **epochs, int *nepochs) {
+    char *log;
+    long size;
+    int n = 0, any = FALSE;
+    FILE *fp;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        error_dump("fail to open %s.", path);
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if (size <= 0 || (log = malloc(size)) == NULL ||
+        (*epochs = malloc((size + 1) * sizeof(int))) == NULL ||
+        fread(log, 1, size, fp) != (size_t)size)
+        error_dump("fail to load %s.", path);
+    fclose(fp);
+    for (long i = 0; i < size; i++)
+        if (log[i] == '$' && i + 6 <= size &&
+            strncmp(log + i + 3, "GGA", 3) == 0)
+            any = TRUE;
+    // An epoch starts at each GGA sentence, or at each
+    // line of a log without any.
+    for (long i = 0; i < size; i++)
+        if (log[i] == '$' && (i == 0 || log[i - 1] == '\n') &&
+            (!any || (i + 6 <= size && strncmp(log + i + 3, "GGA", 3) == 0)))
+            (*epochs)[n++] = i;
+    if (n == 0)
+        error_dump("no sentence in %s.", path);
+    (*epochs)[n] = size;
+    *nepochs = n;
+    return log;
+}
+
+int main(int argc, char *argv[]) {
+    const char *nmea = NULL, *names = NULL;
+    char *log = NULL;
+    int *epochs = NULL;
+    int nepochs = 0, epoch = 0, opt, rate = SIM_NMEA_RATE, timeout, len;
+    double duration = 0, interval = 0;
+    int64_t start, now, next, next_gps, next_report, end;
+    struct pollfd pfds[SIM_MAX_MODULES];
+    sim_module *m;
+    FILE *fp;
+
+    // Usage: as32_sim [-n modules] [-l percent] [-g nmea_log [-r hz]]
+    //                 [-t s] [-i s] [-o file]
+    // -n: simulate n LoRa modules, 2 by default.
+    // -l: lose a percent of the packets on the air.
+    // -g: stream an NMEA log on a GPS pty next to each module.
+    // -r: GPS epochs per second, 1 by default.
+    // -t: stop after s seconds, run until killed by default.
+    // -i: print the counters every s seconds.
+    // -o: write the names of the ptys to a file, a LoRa and a
+    //     GPS pty per module.
+    while ((opt = getopt(argc, argv, "n:l:g:r:t:i:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                nmodules = atoi(optarg);
+                break;
+            case 'l':
+                loss = atof(optarg);
+                break;
+            case 'g':
+                nmea = optarg;
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 't':
+                duration = atof(optarg);
+                break;
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'o':
+                names = optarg;
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (nmodules < 1 || nmodules > SIM_MAX_MODULES || rate <= 0)
+        error_dump("argument misconfiguration.");
+    if (nmea != NULL)
+        log = load_nmea(nmea, &epochs, &nepochs);
+
+    for (int i = 0; i < nmodules; i++) {
+        m = &modules[i];
+        if (sim_open_pty(&m->fd, &m->slave, m->name, sizeof(m->name)) < 0)
+            error_dump("fail to open a pty.");
+        m->gps_fd = -1;
+        if (log != NULL && sim_open_pty(&m->gps_fd, &m->gps_slave,
+            m->gps_name, sizeof(m->gps_name)) < 0)
+            error_dump("fail to open a pty.");
+        m->saved[0] = PERSIST_CMD;
+        m->saved[1] = ADDH;
+        m->saved[2] = ADDL;
+        m->saved[3] = SPEED;
+        m->saved[4] = CHAN;
+        m->saved[5] = OPTION;
+        memcpy(m->param, m->saved, 6);
+        pfds[i].fd = m->fd;
+        pfds[i].events = POLLIN;
+        print_msg("module %d: lora %s gps %s", i, m->name,
+            log != NULL ? m->gps_name : "-");
+    }
+    if (names != NULL) {
+        if ((fp = fopen(names, "w")) == NULL)
+            error_dump("fail to open %s.", names);
+        for (int i = 0; i < nmodules; i++)
+            fprintf(fp, "%s %s\n", modules[i].name,
+                log != NULL ? modules[i].gps_name : "-");
+        fclose(fp);
+    }
+    fflush(stdout);
+
+    start = now = now_ns();
+    end = duration > 0 ? start + (int64_t)(duration * 1e9) : INT64_MAX;
+    next_gps = log != NULL ? start : INT64_MAX;
+    next_report = interval > 0 ? start + (int64_t)(interval * 1e9) : INT64_MAX;
+    while (now < end) {
+        // Sleep until the next packet ends, or the next GPS
+        // epoch or report is due.
+        next = end < next_gps ? end : next_gps;
+        if (next_report < next)
+            next = next_report;
+        for (m = modules; m < modules + nmodules; m++)
+            if (m->air_len > 0 && m->air_end < next)
+                next = m->air_end;
+        timeout = next == INT64_MAX ? -1 : (next - now + 999999) / 1000000;
+        if (poll(pfds, nmodules, timeout) < 0 && errno != EINTR)
+            error_dump("poll error");
+        now = now_ns();
+        for (m = modules; m < modules + nmodules; m++)
+            while (m->air_len > 0 && m->air_end <= now)
+                sim_end_packet(m, now);
+        for (int i = 0; i < nmodules; i++)
+            if (pfds[i].revents & POLLIN)
+                sim_host_input(&modules[i], now);
+        for (; next_gps <= now; next_gps += 1000000000LL / rate) {
+            len = epochs[epoch + 1] - epochs[epoch];
+            for (m = modules; m < modules + nmodules; m++)
+                if (write(m->gps_fd, log + epochs[epoch], len) != len)
+                    m->c.unread += len;
+            epoch = (epoch + 1) % nepochs;
+        }
+        if (now >= next_report) {
+            sim_report((now - start) / 1e9);
+            next_report += (int64_t)(interval * 1e9);
+        }
+    }
+    sim_report((now - start) / 1e9);
+    return 0;
+}
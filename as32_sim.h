@@ -0,0 +1,82 @@
+/** \file as32_sim.h
+ *
+ * Type definitions and function declarations for the
+ * simulator of AS32-TTL-100 modules and GPS modules on
+ * pseudo terminals.
+ */
+
+#ifndef AS32_SIM_H
+#define AS32_SIM_H
+
+#include <stdint.h>                 // For fixed width integers.
+#include "header.h"
+#include "as32_config.h"            // Commands and parameters
+#include "lora_frame.h"             // FRAME_MAX_SIZE
+
+#define SIM_MAX_MODULES   16    //< The most modules simulated.
+#define SIM_BUFFER_SIZE   AS32_BUFFER_SIZE  //< Bytes buffered by a module for the air.
+#define SIM_SUB_PACKET    FRAME_MAX_SIZE  //< The most bytes per air packet.
+#define SIM_READ_CMD      0xc1  //< Read the parameters.
+#define SIM_VERSION_CMD   0xc3  //< Read the version.
+#define SIM_RESET_CMD     0xc4  //< Reset the module.
+#define SIM_VERSION       "AS32-TTL-100 sim"  /*< The version answered,
+                                               * 16 bytes as read by
+                                               * read_as32_version().
+                                               */
+#define SIM_NMEA_RATE     1     //< Default GPS epochs per second.
+
+/** \typedef sim_counters
+ * Counters of one simulated module.
+ */
+typedef struct {
+    unsigned long bytes_in;    /**< Bytes written by the host */
+    unsigned long overflow;    /**< Bytes dropped, the buffer being full */
+    unsigned long packets;     /**< Packets sent on the air */
+    unsigned long air_bytes;   /**< Payload bytes sent on the air */
+    unsigned long received;    /**< Packets delivered to the host */
+    unsigned long lost;        /**< Packets lost on the air */
+    unsigned long collided;    /**< Packets overlapping another one */
+    unsigned long unread;      /**< Bytes the host did not take in time */
+    unsigned long commands;    /**< Commands answered */
+} sim_counters;
+
+/** \typedef sim_module
+ * A simulated AS32-TTL-100 on a pseudo terminal, with the
+ * GPS module next to it on another.
+ */
+typedef struct {
+    int           fd;          /**< Master side of the LoRa pty */
+    int           slave;       /**< Slave side, held open */
+    char          name[64];    /**< Slave name, for the host to open */
+    int           gps_fd;      /**< Master side of the GPS pty, -1 if none */
+    int           gps_slave;   /**< Slave side, held open */
+    char          gps_name[64];  /**< Slave name */
+    unsigned char saved[6];    /**< Parameters kept over a reset */
+    unsigned char param[6];    /**< Parameters in use */
+    unsigned char buf[SIM_BUFFER_SIZE];  /**< Bytes waiting for the air */
+    int           head;        /**< First byte waiting */
+    int           count;       /**< Bytes waiting */
+    unsigned char air[SIM_SUB_PACKET];   /**< The packet on the air */
+    int           air_len;     /**< Its length, 0 when idle */
+    int64_t       air_start;   /**< When it started, in ns */
+    int64_t       air_end;     /**< When it ends */
+    int64_t       last_start;  /**< The previous packet on the air */
+    int64_t       last_end;
+    sim_counters  c;           /**< Counters */
+} sim_module;
+
+// The modules simulated.
+static sim_module modules[SIM_MAX_MODULES];
+// The number of modules simulated.
+static int        nmodules = 2;
+// Percent of packets lost on the air.
+static double     loss;
+
+static int sim_open_pty(int *, int *, char *, int);
+static int sim_command(sim_module *, const unsigned char *, int);
+static void sim_host_input(sim_module *, int64_t);
+static void sim_start_packet(sim_module *, int64_t);
+static void sim_end_packet(sim_module *, int64_t);
+static void sim_report(double);
+
+#endif
@@ -0,0 +1,253 @@
+/** \file capture_log.c
+ *
+ * Function definitions for the capture log of received
+ * frames.
+ *
+ * A capture file is a header followed by fixed size
+ * records, so that a record is found by its index and read
+ * in place, without parsing. The writer fills a record and
+ * then bumps the count in the header with a release store,
+ * and a reader loads the count with an acquire load, so a
+ * reader following a file being written never sees a
+ * partial record.
+ */
+
+#include <stdio.h>         // For snprintf().
+#include <string.h>        // For memcpy(), memset().
+#include <unistd.h>        // For close(), unlink().
+#include <fcntl.h>         // For open(), posix_fallocate().
+#include <time.h>          // For clock_gettime().
+#include <sys/mman.h>      // For mmap().
+#include <sys/stat.h>      // For fstat().
+#include "header.h"
+#include "capture_log.h"
+
+// Both layouts have to be exactly a record long.
+typedef char capture_header_check[
+    sizeof(capture_header) == CAPTURE_RECORD_SIZE ? 1 : -1];
+typedef char capture_record_check[
+    sizeof(capture_record) == CAPTURE_RECORD_SIZE ? 1 : -1];
+
+/** \fn static capture_header *capture_create(const capture_log *log, uint32_t segment)
+ *
+ * Create a capture file, allocate its blocks, and map it.
+ * \param log The capture log.
+ * \param segment The number of the file.
+ * \return Returns NULL on error, or the mapping.
+ */
+static capture_header *capture_create(const capture_log *log, uint32_t segment) {
+    char path[PATH_MAX + 8];
+    capture_header *h;
+    struct timespec now;
+    size_t size = (log->capacity + 1) * CAPTURE_RECORD_SIZE;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s.%06u", log->prefix, segment);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return NULL;
+    // Allocate the blocks now, so that writing the pages
+    // later neither extends the file nor runs out of space.
+    if (posix_fallocate(fd, 0, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED)
+        return NULL;
+    memcpy(h->magic, CAPTURE_MAGIC, sizeof(h->magic));
+    h->version = CAPTURE_VERSION;
+    h->record_size = CAPTURE_RECORD_SIZE;
+    h->capacity = log->capacity;
+    h->segment = segment;
+    clock_gettime(CLOCK_REALTIME, &now);
+    h->created = now.tv_sec * 1000000000LL + now.tv_nsec;
+    return h;
+}
+
+/** \fn static void capture_unmap(capture_header *h)
+ *
+ * Schedule the write back of a capture file and unmap it.
+ */
+static void capture_unmap(capture_header *h) {
+    size_t size = (h->capacity + 1) * CAPTURE_RECORD_SIZE;
+
+    msync(h, size, MS_ASYNC);
+    munmap(h, size);
+}
+
+/** \fn int capture_open(capture_log *log, const char *prefix, uint64_t capacity, int keep)
+ *
+ * Start a capture log.
+ * \param log The capture log.
+ * \param prefix The path of the files, to which the number
+ *        of each file is appended.
+ * \param capacity Records per file.
+ * \param keep The number of files kept, the oldest being
+ *        removed by capture_maintain(), or 0 to keep all.
+ * \return Returns -1 on error, 0 otherwise.
+ */
+int capture_open(capture_log *log, const char *prefix, uint64_t capacity,
+    int keep) {
+    memset(log, 0, sizeof(*log));
+    if (capacity == 0 || strlen(prefix) >= sizeof(log->prefix))
+        return ERROR;
+    strcpy(log->prefix, prefix);
+    log->capacity = capacity;
+    log->keep = keep;
+    if ((log->map = capture_create(log, 0)) == NULL)
+        return ERROR;
+    log->spare = capture_create(log, 1);
+    return OK;
+}
+
+/** \fn static void capture_rotate(capture_log *log)
+ *
+ * Move to the next file, which capture_maintain() created,
+ * retiring the current one, without any system call but
+ * when the file before is still mapped.
+ */
+static void capture_rotate(capture_log *log) {
+    if (log->retired != NULL)
+        capture_unmap(log->retired);
+    log->retired = log->map;
+    log->map = log->spare;
+    log->spare = NULL;
+    log->segment++;
+}
+
+/** \fn void capture_maintain(capture_log *log)
+ *
+ * Do the file work of the capture log out of the packet
+ * path, e.g., once a second: unmap the file retired by the
+ * last rotation, create the next file if it is missing,
+ * and remove the files beyond those kept.
+ * \param log The capture log.
+ */
+void capture_maintain(capture_log *log) {
+    char path[PATH_MAX + 8];
+
+    if (log->retired != NULL) {
+        capture_unmap(log->retired);
+        log->retired = NULL;
+    }
+    // Tried again on each call, if it failed.
+    if (log->spare == NULL)
+        log->spare = capture_create(log, log->segment + 1);
+    for (; log->keep > 0 && log->removed + log->keep <= log->segment;
+        log->removed++) {
+        snprintf(path, sizeof(path), "%s.%06u", log->prefix, log->removed);
+        unlink(path);
+    }
+}
+
+/** \fn int capture_append(capture_log *log, const capture_record *rec)
+ *
+ * Append a record to the capture log.
+ * \param log The capture log.
+ * \param rec The record.
+ * \return Returns -1 if the record was dropped, the file
+ *         being full and the next one not created yet,
+ *         0 otherwise.
+ */
+int capture_append(capture_log *log, const capture_record *rec) {
+    capture_record *slot;
+    uint64_t n;
+
+    if (log->map->count == log->capacity) {
+        if (log->spare == NULL) {
+            log->dropped++;
+            return ERROR;
+        }
+        capture_rotate(log);
+    }
+    n = log->map->count;
+    slot = (capture_record *)log->map + 1 + n;
+    memcpy(slot, rec, sizeof(*slot));
+    __atomic_store_n(&log->map->count, n + 1, __ATOMIC_RELEASE);
+    log->records++;
+    return OK;
+}
+
+/** \fn void capture_close(capture_log *log)
+ *
+ * Stop a capture log, removing the spare file, which has
+ * no records.
+ */
+void capture_close(capture_log *log) {
+    char path[PATH_MAX + 8];
+
+    if (log->retired != NULL)
+        capture_unmap(log->retired);
+    if (log->map != NULL)
+        capture_unmap(log->map);
+    if (log->spare != NULL) {
+        capture_unmap(log->spare);
+        snprintf(path, sizeof(path), "%s.%06u", log->prefix, log->segment + 1);
+        unlink(path);
+    }
+    log->map = log->spare = log->retired = NULL;
+}
+
+/** \fn int capture_reader_open(capture_reader *r, const char *path)
+ *
+ * Open a capture file for reading.
+ * \param r The reader.
+ * \param path The path of the file.
+ * \return Returns -1 on error or if the file is not a
+ *         capture file, 0 otherwise.
+ */
+int capture_reader_open(capture_reader *r, const char *path) {
+    const capture_header *h;
+    struct stat st;
+    int fd;
+
+    memset(r, 0, sizeof(*r));
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return ERROR;
+    if (fstat(fd, &st) < 0 || st.st_size < CAPTURE_RECORD_SIZE) {
+        close(fd);
+        return ERROR;
+    }
+    h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED)
+        return ERROR;
+    if (memcmp(h->magic, CAPTURE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != CAPTURE_VERSION ||
+        h->record_size != CAPTURE_RECORD_SIZE ||
+        (h->capacity + 1) * CAPTURE_RECORD_SIZE > (uint64_t)st.st_size) {
+        munmap((void *)h, st.st_size);
+        return ERROR;
+    }
+    r->map = h;
+    r->size = st.st_size;
+    return OK;
+}
+
+/** \fn const capture_record *capture_reader_next(capture_reader *r)
+ *
+ * Get the next record of a capture file. Once the records
+ * written so far are read, records appended later are
+ * returned by later calls.
+ * \param r The reader.
+ * \return Returns NULL if there is no record yet, or the
+ *         record, in place in the mapping.
+ */
+const capture_record *capture_reader_next(capture_reader *r) {
+    uint64_t count = __atomic_load_n(&r->map->count, __ATOMIC_ACQUIRE);
+
+    if (r->next >= count || r->next >= r->map->capacity)
+        return NULL;
+    return (const capture_record *)r->map + 1 + r->next++;
+}
+
+/** \fn void capture_reader_close(capture_reader *r)
+ *
+ * Close a capture file.
+ */
+void capture_reader_close(capture_reader *r) {
+    if (r->map != NULL)
+        munmap((void *)r->map, r->size);
+    r->map = NULL;
+}
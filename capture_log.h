@@ -0,0 +1,111 @@
+/** \file capture_log.h
+ *
+ * Type definitions and function declarations for the
+ * capture log of received frames.
+ */
+
+#ifndef _CAPTURE_LOG_H
+#define _CAPTURE_LOG_H
+
+#include <stdint.h>          // For fixed width integers.
+#include <stddef.h>          // For size_t.
+#include <limits.h>          // For PATH_MAX.
+#include "lora_frame.h"      // FRAME_MAX_PAYLOAD.
+
+#define CAPTURE_MAGIC       "LORACAP"  //< The first bytes of a capture file.
+#define CAPTURE_VERSION     1       //< Version of the capture format.
+#define CAPTURE_RECORD_SIZE 128     //< Bytes per record, and of the header.
+#define CAPTURE_RECORDS     65536   //< Default records per file, 8 MiB.
+
+// Flags of a capture record.
+#define CAPTURE_DECODED     0x01    //< The decoded fields are valid.
+#define CAPTURE_LOCAL_FIX   0x02    //< The local fix fields are valid.
+#define CAPTURE_TX_TIME     0x04    //< The transmit time is valid.
+
+/** \typedef capture_header
+ * The first CAPTURE_RECORD_SIZE bytes of a capture file,
+ * followed by capacity records.
+ */
+typedef struct {
+    char     magic[8];      /**< CAPTURE_MAGIC */
+    uint32_t version;       /**< CAPTURE_VERSION */
+    uint32_t record_size;   /**< CAPTURE_RECORD_SIZE */
+    uint64_t capacity;      /**< Records the file holds */
+    uint64_t count;         /**< Records written, updated after
+                                 each record is complete */
+    int64_t  created;       /**< When the file was started, in
+                                 nanoseconds since the epoch */
+    uint32_t segment;       /**< Number of the file in rotation */
+    uint8_t  reserved[CAPTURE_RECORD_SIZE - 44];
+} capture_header;
+
+/** \typedef capture_record
+ * A frame received, as captured. Positions are in 1e-7
+ * degrees and altitudes in decimeters, as in
+ * position_report.
+ */
+typedef struct {
+    int64_t  rx_time;       /**< Nanoseconds since the epoch */
+    int64_t  rx_mono;       /**< The same on CLOCK_MONOTONIC */
+    uint8_t  port;          /**< Index of the LoRa module */
+    uint8_t  len;           /**< Payload length */
+    uint8_t  flags;         /**< CAPTURE_DECODED, ... */
+    uint8_t  seq_type;      /**< SEQ_IN_ORDER, ... if decoded */
+    uint16_t addr;          /**< Sender address, if decoded */
+    uint8_t  fix_quality;   /**< Fix quality of the sender */
+    uint8_t  local_quality; /**< Fix quality of the receiver */
+    uint32_t seq;           /**< Sequence number */
+    int32_t  latitude;      /**< Position of the sender */
+    int32_t  longitude;
+    int32_t  altitude;
+    int32_t  tx_time;       /**< Transmit time, ms of the UTC day */
+    int32_t  local_latitude;  /**< Latest fix of the receiver */
+    int32_t  local_longitude;
+    int32_t  local_altitude;
+    int32_t  fix_age;       /**< Microseconds since that fix */
+    uint8_t  payload[FRAME_MAX_PAYLOAD];  /**< The frame payload */
+    uint8_t  reserved[CAPTURE_RECORD_SIZE - 60 - FRAME_MAX_PAYLOAD];
+} capture_record;
+
+/** \typedef capture_log
+ * A writer appending records to pre-allocated, memory
+ * mapped files named prefix.000000, prefix.000001, ...
+ * A record is a copy into the mapping, and the kernel
+ * writes the pages back, so appending never waits for the
+ * disk. A rotation only swaps mappings: the next file is
+ * created and mapped, and the files done with are unmapped
+ * and removed, by capture_maintain() outside the packet
+ * path.
+ */
+typedef struct {
+    char            prefix[PATH_MAX];  /**< Path of the files, less the number */
+    uint64_t        capacity;   /**< Records per file */
+    int             keep;       /**< Files kept, 0 for all */
+    uint32_t        segment;    /**< Number of the current file */
+    uint32_t        removed;    /**< The next file to remove */
+    capture_header *map;        /**< The current file */
+    capture_header *spare;      /**< The next file, NULL until created */
+    capture_header *retired;    /**< The file before, until unmapped */
+    unsigned long   records;    /**< Records written */
+    unsigned long   dropped;    /**< Records without a file to go to */
+} capture_log;
+
+/** \typedef capture_reader
+ * A reader iterating the records of a capture file, which
+ * may still be written.
+ */
+typedef struct {
+    const capture_header *map;  /**< The file */
+    size_t                size; /**< Bytes mapped */
+    uint64_t              next; /**< The next record */
+} capture_reader;
+
+int capture_open(capture_log *, const char *, uint64_t, int);
+int capture_append(capture_log *, const capture_record *);
+void capture_maintain(capture_log *);
+void capture_close(capture_log *);
+int capture_reader_open(capture_reader *, const char *);
+const capture_record *capture_reader_next(capture_reader *);
+void capture_reader_close(capture_reader *);
+
+#endif
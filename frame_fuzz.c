@@ -0,0 +1,205 @@
+/** \file frame_fuzz.c
+ *
+ * Fuzz test and benchmark of the frame parser on a
+ * synthetic noisy stream, without any module attached.
+ *
+ * The stream holds frames of random payloads, with up to
+ * FUZZ_MAX_NOISE noise bytes between them, a quarter of
+ * which are FRAME_SYNC1. A share of the frames is damaged:
+ * a bit flipped, cut short, a wrong length byte, or the
+ * first sync byte lost. The stream goes through
+ * read_frame() as in the receiver, and every frame sent
+ * intact should come out once, whatever damaged frame or
+ * noise is before it. A frame that is not one of those
+ * sent is noise passing the CRC, which CRC-16 lets through
+ * once in about 65536 tries; it is counted, and so are the
+ * intact frames it swallows, at most FUZZ_SWALLOWED. A
+ * frame whose first sync byte is lost comes out whole when
+ * the noise before it ends with FRAME_SYNC1, and is counted
+ * as rebuilt.
+ *
+ * The parse is timed, in MB and frames per second.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include "frame_fuzz.h"
+
+/** \fn static int fuzz_damage(unsigned char *frame, int len)
+ *
+ * Damage a frame in one of the FUZZ_KINDS ways.
+ * \param frame The frame.
+ * \param len The frame length.
+ * \return Returns the length of the damaged frame.
+ */
+static int fuzz_damage(unsigned char *frame, int len) {
+    int at;
+
+    switch (rand() % FUZZ_KINDS) {
+        case FUZZ_FLIP:
+            at = rand() % len;
+            frame[at] ^= 1 << rand() % 8;
+            return len;
+        case FUZZ_CUT:
+            return 1 + rand() % (len - 1);
+        case FUZZ_LENGTH:
+            do
+                at = rand() % 256;
+            while (at == frame[2]);
+            frame[2] = at;
+            return len;
+        default:
+            memmove(frame, frame + 1, len - 1);
+            return len - 1;
+    }
+}
+
+/** \fn static int fuzz_noise(unsigned char *buf)
+ *
+ * Make the noise between two frames.
+ * \param buf Where to store the noise, FUZZ_MAX_NOISE bytes.
+ * \return Returns the number of noise bytes.
+ */
+static int fuzz_noise(unsigned char *buf) {
+    int n = rand() % (FUZZ_MAX_NOISE + 1);
+
+    for (int i = 0; i < n; i++)
+        buf[i] = rand() % 4 == 0 ? FRAME_SYNC1 : rand() % 256;
+    return n;
+}
+
+/** \fn static int fuzz_stream(int fd, int damaged)
+ *
+ * Write the stream of the frames, keeping them for the
+ * check.
+ * \param fd Where to write the stream.
+ * \param damaged The percent of frames damaged.
+ * \return Returns -1 on error, or the number of frames
+ *         sent intact.
+ */
+static int fuzz_stream(int fd, int damaged) {
+    unsigned char buf[BUF_SIZE], frame[FRAME_MAX_SIZE];
+    int used = 0, intact = 0, len;
+    fuzz_frame *f;
+
+    for (int i = 0; i < nframes; i++) {
+        f = &frames[i];
+        // The index comes first, the rest is random.
+        f->len = 4 + rand() % (FRAME_MAX_PAYLOAD - 3);
+        for (int k = 0; k < f->len; k++)
+            f->payload[k] = rand() % 256;
+        memcpy(f->payload, &i, 4);
+        len = frame_encode(frame, f->payload, f->len);
+        f->intact = rand() % 100 >= damaged;
+        if (!f->intact)
+            len = fuzz_damage(frame, len);
+        else
+            intact++;
+
+        if (used + len + FUZZ_MAX_NOISE > (int)sizeof(buf)) {
+            if (write_all(fd, buf, used) < 0)
+                return ERROR;
+            used = 0;
+        }
+        memcpy(buf + used, frame, len);
+        used += len;
+        used += fuzz_noise(buf + used);
+    }
+    if (write_all(fd, buf, used) < 0)
+        return ERROR;
+    return intact;
+}
+
+/** \fn static fuzz_frame *fuzz_match(const unsigned char *payload, int len)
+ *
+ * Find the frame sent of a payload parsed.
+ * \return Returns the frame, or NULL if none was sent so.
+ */
+static fuzz_frame *fuzz_match(const unsigned char *payload, int len) {
+    int i;
+
+    if (len < 4)
+        return NULL;
+    memcpy(&i, payload, 4);
+    if (i < 0 || i >= nframes || frames[i].len != len ||
+        memcmp(frames[i].payload, payload, len) != 0)
+        return NULL;
+    return &frames[i];
+}
+
+int main(int argc, char *argv[]) {
+    frame_parser parser;
+    ring_reader *r;
+    const unsigned char *buf;
+    struct timespec start, stop;
+    fuzz_frame *f;
+    FILE *stream;
+    unsigned long found = 0, missed = 0, twice = 0, spurious = 0, rebuilt = 0;
+    int opt, fd, len, intact, damaged = FUZZ_DAMAGED;
+    unsigned seed = 1;
+    double seconds;
+
+    // Usage: frame_fuzz [-n frames] [-d percent] [-s seed]
+    // -n: frames in the stream, FUZZ_FRAMES by default.
+    // -d: damage a percent of the frames, FUZZ_DAMAGED by
+    //     default.
+    // -s: the seed of the stream, 1 by default.
+    while ((opt = getopt(argc, argv, "n:d:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                nframes = atoi(optarg);
+                break;
+            case 'd':
+                damaged = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (nframes < 1 || damaged < 0 || damaged > 100)
+        error_dump("argument misconfiguration.");
+
+    if ((frames = calloc(nframes, sizeof(*frames))) == NULL)
+        error_dump("fail to allocate %d frames.", nframes);
+    if ((stream = tmpfile()) == NULL)
+        error_dump("fail to create the stream.");
+    fd = fileno(stream);
+    srand(seed);
+    if ((intact = fuzz_stream(fd, damaged)) < 0)
+        error_dump("fail to write the stream.");
+    if (lseek(fd, 0, SEEK_SET) < 0 || (r = get_ring_reader(fd)) == NULL)
+        error_dump("fail");
+
+    frame_parser_init(&parser);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((len = read_frame(&parser, r, &buf)) >= 0) {
+        if ((f = fuzz_match(buf, len)) == NULL)
+            spurious++;
+        else if (f->found++ > 0)
+            twice++;
+        else if (!f->intact)
+            rebuilt++;
+        else
+            found++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    seconds = (stop.tv_sec - start.tv_sec) +
+        (stop.tv_nsec - start.tv_nsec) / 1e9;
+    for (int i = 0; i < nframes; i++)
+        missed += frames[i].intact && frames[i].found == 0;
+
+    print_frame_stats(&parser);
+    print_msg("seed %u: %d frames, %d intact: %lu found, %lu missed, "
+              "%lu twice, %lu rebuilt, %lu spurious.",
+        seed, nframes, intact, found, missed, twice, rebuilt, spurious);
+    print_msg("%lu bytes in %.3f s: %.1f MB/s, %.0f frames/s.",
+        r->nbytes, seconds, r->nbytes / seconds / 1e6,
+        parser.frames / seconds);
+    fclose(stream);
+    free(frames);
+    return missed <= FUZZ_SWALLOWED * spurious && twice == 0 ? OK : ERROR;
+}
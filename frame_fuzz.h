@@ -0,0 +1,51 @@
+/** \file frame_fuzz.h
+ *
+ * Function declarations for the fuzz test and benchmark of
+ * the frame parser on a synthetic noisy stream.
+ */
+
+#ifndef FRAME_FUZZ_H
+#define FRAME_FUZZ_H
+
+#include <time.h>                   // Timing of the parser
+#include "header.h"
+#include "io_ops.h"                 // Ring reader
+#include "lora_frame.h"             // Framing on the serial link
+
+#define FUZZ_FRAMES     100000      //< Frames in the stream by default.
+#define FUZZ_DAMAGED    10          //< Percent of frames damaged by default.
+#define FUZZ_MAX_NOISE  8           //< The most noise bytes between frames.
+#define FUZZ_SWALLOWED  (FRAME_MAX_SIZE / (FRAME_OVERHEAD + 4) + 1)
+                                    /*< The most frames a spurious frame
+                                     * overlaps, as the shortest frame
+                                     * holds a 4 byte index.
+                                     */
+
+// Ways a frame is damaged.
+#define FUZZ_FLIP       0           //< A bit flipped.
+#define FUZZ_CUT        1           //< Cut short.
+#define FUZZ_LENGTH     2           //< A wrong length byte.
+#define FUZZ_NO_SYNC    3           //< The first sync byte lost.
+#define FUZZ_KINDS      4
+
+/** \typedef fuzz_frame
+ * A frame of the stream, as sent.
+ */
+typedef struct {
+    int           len;                        /**< Payload length */
+    int           intact;                     /**< Whether it was not damaged */
+    int           found;                      /**< Times it was parsed */
+    unsigned char payload[FRAME_MAX_PAYLOAD]; /**< The payload */
+} fuzz_frame;
+
+// The frames of the stream.
+static fuzz_frame *frames;
+// The number of frames.
+static int         nframes = FUZZ_FRAMES;
+
+static int fuzz_damage(unsigned char *, int);
+static int fuzz_noise(unsigned char *);
+static int fuzz_stream(int, int);
+static fuzz_frame *fuzz_match(const unsigned char *, int);
+
+#endif
@@ -6,9 +6,14 @@
 #include "header.h"
 #include "gps_analyzer.h"
 
+// Sentences accepted and rejected by read_raw_gps().
+static nmea_stats stats;
+
 /** \fn int read_raw_gps(int fd, char *buf)
  *
  * Read raw GPS information from Ublox NEO-7N module.
+ * Lines that are too long, or fail the checksum check,
+ * are counted and skipped.
  * \param fd The serial port where GPS module is mounted.
  * \param buf Where the raw GPS information will be stored.
  * \return Returns -1 on error, non-negative integer which 
@@ -16,30 +21,139 @@
  *         success.
  */
 int read_raw_gps(int fd, char *buf) {
-    int cnt = 0;
-
-    memset(buf, '\0', GPS_INFO_SIZE);
-    while ((*(buf + cnt) = read_a_char(fd)) != '\n' 
-        && cnt < GPS_INFO_SIZE) {
-        if (*(buf + cnt) == '\r')
-            *(buf + cnt) = '\0';
-        cnt++;
-    }
+    ring_reader *r;
+    char *line;
+    int cnt;
 
-    *(buf + cnt) = '\0';
+    // Lines are taken out of the ring reader of this port,
+    // which reads the port in large chunks.
+    if ((r = get_ring_reader(fd)) == NULL)
+        return -1;
+    while (1) {
+        if ((line = ring_read_line(r, &cnt)) == NULL)
+            return -1;
+        if (cnt >= GPS_INFO_SIZE) {
+            stats.malformed++;
+            continue;
+        }
+        if (nmea_verify(line, cnt) == TRUE)
+            break;
+    }
 
-    if (cnt >= GPS_INFO_SIZE) return -1;
+    memcpy(buf, line, cnt + 1);
     return cnt;
 }
 
+/** \fn unsigned char nmea_xor(const char *p, int len)
+ *
+ * Compute the XOR of a buffer, eight bytes at a time.
+ * \param p The buffer.
+ * \param len The number of bytes.
+ * \return Returns the XOR of all bytes.
+ */
+unsigned char nmea_xor(const char *p, int len) {
+    uint64_t acc = 0, word;
+    unsigned char x;
+    int i;
+
+    // XOR is bitwise, so the bytes of a word can be folded
+    // together after the loop.
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&word, p + i, 8);
+        acc ^= word;
+    }
+    acc ^= acc >> 32;
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    x = (unsigned char)acc;
+
+    for (; i < len; i++)
+        x ^= (unsigned char)p[i];
+    return x;
+}
+
+/** \fn static int hex_value(char ch)
+ *
+ * Get the value of a hexadecimal digit, -1 if it is not.
+ */
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+/** \fn int nmea_verify(const char *line, int len)
+ *
+ * Verify the "*hh" checksum of a sentence, which is the
+ * XOR of all characters between '$' and '*'. The result
+ * is counted in the statistics of get_nmea_stats().
+ * \param line The sentence without line feed.
+ * \param len The length of the sentence.
+ * \return Returns 1 if the checksum matches, 0 otherwise.
+ */
+int nmea_verify(const char *line, int len) {
+    int hi, lo;
+
+    if (len < 1 || line[0] != '$') {
+        stats.malformed++;
+        return FALSE;
+    }
+    if (len < 4 || line[len - 3] != '*' ||
+        (hi = hex_value(line[len - 2])) < 0 ||
+        (lo = hex_value(line[len - 1])) < 0) {
+        stats.no_checksum++;
+        return FALSE;
+    }
+    if (nmea_xor(line + 1, len - 4) != ((hi << 4) | lo)) {
+        stats.bad_checksum++;
+        return FALSE;
+    }
+    stats.accepted++;
+    return TRUE;
+}
+
+/** \fn const nmea_stats *get_nmea_stats(void)
+ *
+ * Get the counters of accepted and rejected sentences.
+ */
+const nmea_stats *get_nmea_stats(void) {
+    return &stats;
+}
+
+/** \fn void print_nmea_counters(const nmea_stats *c)
+ *
+ * Print counters of accepted and rejected sentences, e.g.,
+ * a copy taken by another thread.
+ */
+void print_nmea_counters(const nmea_stats *c) {
+    print_msg("NMEA: %lu accepted, %lu bad checksum, "
+              "%lu no checksum, %lu malformed.",
+        c->accepted, c->bad_checksum, 
+        c->no_checksum, c->malformed);
+}
+
+/** \fn void print_nmea_stats(void)
+ *
+ * Print the counters of accepted and rejected sentences,
+ * from the thread reading the GPS module.
+ */
+void print_nmea_stats(void) {
+    print_nmea_counters(&stats);
+}
+
 /** \fn int is_gpgga(char *cmd)
  *
- * Check whether given command is a GPGGA information.
+ * Check whether given command is a GGA information from
+ * either the GP or the GN talker.
  * \param cmd The command.
  * \return Returns 1 if is, 0 otherwise.
  */
 int is_gpgga(char *cmd) {
-    if (strncmp(cmd, "$GPGGA", 6))
+    if (nmea_sentence_type(cmd) != NMEA_GGA)
         return FALSE;
     else
         return TRUE;
@@ -58,7 +172,6 @@ char *get_nth_parameter(char *cmd, int n, char *buf) {
     int i, j;
     if (n >= GPS_INFO_SIZE)
         return NULL;
-    memset(buf, '\0', sizeof(buf));
 
     // Skip the first n - 1 parameters. 
     for (i = 0, j = 0; j < GPS_INFO_SIZE && i < n; j++)
@@ -76,93 +189,291 @@ char *get_nth_parameter(char *cmd, int n, char *buf) {
     return buf;
 }
 
-/** \fn char *get_utc_time(char *cmd, char *param)
+/** \fn int nmea_tokenize(const char *cmd, nmea_fields *f)
  *
- * Get the UTC time from the GPGGA information.
- * \param cmd The raw GPS information.
- * \param param Where to store the UTC time.
- * \return Returns NULL on error, or address storing
- *         UTC time on success.
+ * Walk a sentence once and record where each of its
+ * fields begins and how long it is.
+ * \param cmd The raw GPS information, or any other comma
+ *        separated string.
+ * \param f Where to store the field table.
+ * \return Returns -1 on error, or the number of fields
+ *         on success.
  */
-char *get_utc_time(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
-        return NULL;
-    return get_nth_parameter(cmd, 1, param);
+int nmea_tokenize(const char *cmd, nmea_fields *f) {
+    int i, n = 0, start = 0;
+    char ch;
+
+    f->sentence = cmd;
+    for (i = 0; ; i++) {
+        ch = *(cmd + i);
+        if (ch != ',' && ch != '*' && ch != '\0')
+            continue;
+        if (n == NMEA_MAX_FIELDS || i > NMEA_MAX_LENGTH)
+            return ERROR;
+        f->offset[n] = start;
+        f->length[n] = i - start;
+        n++;
+        if (ch != ',')
+            break;
+        start = i + 1;
+    }
+    f->count = n;
+    return n;
 }
 
-/** \fn char *get_latitude(char *cmd, char *param)
+/** \fn const char *nmea_field(const nmea_fields *f, int n, int *len)
  *
- * Get the latitude from the GPGGA information.
- * \param cmd The raw GPS information.
- * \param param Where to store the latitude.
- * \return Returns NULL on error, or address storing
- *         latitude on success.
+ * Get the nth field of a tokenized sentence. The field is
+ * not copied, and it is terminated by a comma, a '*' or
+ * '\0' rather than '\0' only, which strtod() accepts.
+ * \param f The field table.
+ * \param n Denoting which field to be found.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or the address of the nth
+ *         field within the sentence on success.
  */
-char *get_latitude(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
+const char *nmea_field(const nmea_fields *f, int n, int *len) {
+    if (n < 0 || n >= f->count)
         return NULL;
-    return get_nth_parameter(cmd, 2, param);
+    if (len != NULL)
+        *len = f->length[n];
+    return f->sentence + f->offset[n];
 }
 
-/** \fn char *get_ns_hemisphere(char *cmd, char *param)
+/** \fn const char *get_utc_time(const nmea_fields *f, int *len)
  *
- * Get the north or south hemisphere from the GPGGA information.
- * \param cmd The raw GPS information.
- * \param param Where to store the hemisphere.
- * \return Returns NULL on error, or address storing
- *         hemisphere on success.
+ * Get the UTC time from the tokenized GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of UTC time
+ *         on success.
  */
-char *get_ns_hemisphere(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
-        return NULL;
-    return get_nth_parameter(cmd, 3, param);
+const char *get_utc_time(const nmea_fields *f, int *len) {
+    return nmea_field(f, 1, len);
 }
 
-/** \fn char *get_longitude(char *cmd, char *param)
+/** \fn const char *get_latitude(const nmea_fields *f, int *len)
  *
- * Get the longitude from the GPGGA information.
- * \param cmd The raw GPS information.
- * \param param Where to store the longitude.
- * \return Returns NULL on error, or address storing
- *         longitude on success.
+ * Get the latitude from the tokenized GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of latitude
+ *         on success.
+ */
+const char *get_latitude(const nmea_fields *f, int *len) {
+    return nmea_field(f, 2, len);
+}
+
+/** \fn const char *get_ns_hemisphere(const nmea_fields *f, int *len)
+ *
+ * Get the north or south hemisphere from the tokenized 
+ * GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of hemisphere
+ *         on success.
+ */
+const char *get_ns_hemisphere(const nmea_fields *f, int *len) {
+    return nmea_field(f, 3, len);
+}
+
+/** \fn const char *get_longitude(const nmea_fields *f, int *len)
+ *
+ * Get the longitude from the tokenized GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of longitude
+ *         on success.
+ */
+const char *get_longitude(const nmea_fields *f, int *len) {
+    return nmea_field(f, 4, len);
+}
+
+/** \fn const char *get_ew_hemisphere(const nmea_fields *f, int *len)
+ *
+ * Get the east or west hemisphere from the tokenized
+ * GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of hemisphere
+ *         on success.
+ */
+const char *get_ew_hemisphere(const nmea_fields *f, int *len) {
+    return nmea_field(f, 5, len);
+}
+
+/** \fn const char *get_altitude(const nmea_fields *f, int *len)
+ *
+ * Get the altitude from the tokenized GPGGA information.
+ * \param f The field table.
+ * \param len Where to store the field length, may be NULL.
+ * \return Returns NULL on error, or address of altitude
+ *         on success.
+ */
+const char *get_altitude(const nmea_fields *f, int *len) {
+    return nmea_field(f, 9, len);
+}
+
+/** \fn static double field_double(const nmea_fields *f, int n)
+ *
+ * Convert the nth field to a double, 0 if it is empty.
+ */
+static double field_double(const nmea_fields *f, int n) {
+    if (n >= f->count || f->length[n] == 0)
+        return 0;
+    return strtod(f->sentence + f->offset[n], NULL);
+}
+
+/** \fn static char field_char(const nmea_fields *f, int n)
+ *
+ * Get the first character of the nth field, '\0' if it
+ * is empty.
  */
-char *get_longitude(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
+static char field_char(const nmea_fields *f, int n) {
+    if (n >= f->count || f->length[n] == 0)
+        return '\0';
+    return f->sentence[f->offset[n]];
+}
+
+/** \fn static void decode_gga(const nmea_fields *f, gps_info *pg)
+ *
+ * Decode the fields of a GGA sentence.
+ */
+static void decode_gga(const nmea_fields *f, gps_info *pg) {
+    pg->utc_time = field_double(f, 1);
+    pg->latitude = field_double(f, 2);
+    pg->ns_hemisphere = field_char(f, 3);
+    pg->longitude = field_double(f, 4);
+    pg->ew_hemisphere = field_char(f, 5);
+    pg->fix_quality = (int)field_double(f, 6);
+    pg->satellites = (int)field_double(f, 7);
+    pg->hdop = field_double(f, 8);
+    pg->altitude = field_double(f, 9);
+}
+
+/** \fn static void decode_rmc(const nmea_fields *f, gps_info *pg)
+ *
+ * Decode the fields of an RMC sentence, converting
+ * the speed from knots to km/h.
+ */
+static void decode_rmc(const nmea_fields *f, gps_info *pg) {
+    pg->utc_time = field_double(f, 1);
+    pg->status = field_char(f, 2);
+    pg->latitude = field_double(f, 3);
+    pg->ns_hemisphere = field_char(f, 4);
+    pg->longitude = field_double(f, 5);
+    pg->ew_hemisphere = field_char(f, 6);
+    pg->speed = field_double(f, 7) * KNOT_KMH;
+    pg->course = field_double(f, 8);
+    pg->date = (int)field_double(f, 9);
+}
+
+/** \fn static void decode_gsa(const nmea_fields *f, gps_info *pg)
+ *
+ * Decode the fix type and DOPs of a GSA sentence.
+ */
+static void decode_gsa(const nmea_fields *f, gps_info *pg) {
+    pg->fix_type = (int)field_double(f, 2);
+    pg->pdop = field_double(f, 15);
+    pg->hdop = field_double(f, 16);
+    pg->vdop = field_double(f, 17);
+}
+
+/** \fn static void decode_vtg(const nmea_fields *f, gps_info *pg)
+ *
+ * Decode the fields of a VTG sentence.
+ */
+static void decode_vtg(const nmea_fields *f, gps_info *pg) {
+    pg->course = field_double(f, 1);
+    pg->speed = field_double(f, 7);
+}
+
+// The sentence identifier packed in an integer, e.g.,
+// 'G' 'G' 'A' for GGA.
+#define NMEA_ID(a, b, c) (((a) << 16) | ((b) << 8) | (c))
+// A perfect hash of the identifiers of supported sentences.
+#define NMEA_HASH(a, b, c) (((a) + (b) + (c)) & 7)
+
+/** \typedef nmea_decoder
+ * An entry of the dispatch table.
+ */
+typedef struct {
+    int  id;        /**< Sentence identifier, 0 if unused */
+    int  type;      /**< NMEA_GGA, NMEA_RMC, ... */
+    int  fields;    /**< The least number of fields */
+    void (*decode)(const nmea_fields *, gps_info *);
+} nmea_decoder;
+
+// The dispatch table indexed by NMEA_HASH().
+static const nmea_decoder decoders[8] = {
+    [NMEA_HASH('V', 'T', 'G')] = 
+        { NMEA_ID('V', 'T', 'G'), NMEA_VTG, 8,  decode_vtg },
+    [NMEA_HASH('R', 'M', 'C')] = 
+        { NMEA_ID('R', 'M', 'C'), NMEA_RMC, 10, decode_rmc },
+    [NMEA_HASH('G', 'S', 'A')] = 
+        { NMEA_ID('G', 'S', 'A'), NMEA_GSA, 18, decode_gsa },
+    [NMEA_HASH('G', 'G', 'A')] = 
+        { NMEA_ID('G', 'G', 'A'), NMEA_GGA, 10, decode_gga },
+};
+
+/** \fn static const nmea_decoder *find_decoder(const char *cmd)
+ *
+ * Look up the decoder of a sentence by its talker and
+ * sentence identifier, without comparing strings.
+ */
+static const nmea_decoder *find_decoder(const char *cmd) {
+    const nmea_decoder *d;
+
+    // The talker must be GP or GN. Checking the characters
+    // in order also stops at the end of a short sentence.
+    if (cmd[0] != '$' || cmd[1] != 'G' || 
+        (cmd[2] != 'P' && cmd[2] != 'N') ||
+        cmd[3] == '\0' || cmd[4] == '\0' || cmd[5] == '\0')
+        return NULL;
+    d = &decoders[NMEA_HASH(cmd[3], cmd[4], cmd[5])];
+    if (d->id != NMEA_ID(cmd[3], cmd[4], cmd[5]))
         return NULL;
-    return get_nth_parameter(cmd, 4, param);
+    return d;
 }
 
-/** \fn char *get_ew_hemisphere(char *cmd, char *param)
+/** \fn int nmea_sentence_type(const char *cmd)
  *
- * Get the east or west hemisphere from the GPGGA information.
+ * Get the type of a sentence.
  * \param cmd The raw GPS information.
- * \param param Where to store the hemisphere.
- * \return Returns NULL on error, or address storing
- *         hemisphere on success.
+ * \return Returns NMEA_UNKNOWN for unsupported sentences, or
+ *         one of NMEA_GGA, NMEA_RMC, NMEA_GSA and NMEA_VTG.
  */
-char *get_ew_hemisphere(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
-        return NULL;
-    return get_nth_parameter(cmd, 5, param);
+int nmea_sentence_type(const char *cmd) {
+    const nmea_decoder *d = find_decoder(cmd);
+    return d == NULL ? NMEA_UNKNOWN : d->type;
 }
 
-/** \fn char *get_altitude(char *cmd, char *param)
+/** \fn int decode_nmea(const char *cmd, gps_info *pg)
  *
- * Get the altitude from the GPGGA information.
+ * Decode a GGA, RMC, GSA or VTG sentence into the GPS 
+ * information, which accumulates the fields of every
+ * sentence decoded into it.
  * \param cmd The raw GPS information.
- * \param param Where to store the altitude.
- * \return Returns NULL on error, or address storing
- *         altitude on success.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns NMEA_UNKNOWN for unsupported or malformed
+ *         sentences, or the type of the decoded sentence.
  */
-char *get_altitude(char *cmd, char *param) {
-    if (is_gpgga(cmd) != TRUE)
-        return NULL;
-    return get_nth_parameter(cmd, 9, param);
+int decode_nmea(const char *cmd, gps_info *pg) {
+    const nmea_decoder *d;
+    nmea_fields f;
+
+    if ((d = find_decoder(cmd)) == NULL ||
+        nmea_tokenize(cmd, &f) < d->fields)
+        return NMEA_UNKNOWN;
+    d->decode(&f, pg);
+    pg->updated |= NMEA_BIT(d->type);
+    return d->type;
 }
 
 /** \fn gps_info *get_gps_info(char *cmd, gps_info *pg)
  *
- * Get the basic GPS information from the GPGGA command.
+ * Get the basic GPS information from the GGA command.
  * \param cmd The raw GPS information.
  * \param pg The address of structure representing GPS
  *           information.
@@ -170,32 +481,56 @@ char *get_altitude(char *cmd, char *param) {
  *         success.
  */
 gps_info *get_gps_info(char *cmd, gps_info *pg) {
-    char param[20];
-    if (get_utc_time(cmd, param) == NULL)
-        return NULL;
-    pg->utc_time = strtod(param, NULL);
-
-    if (get_latitude(cmd, param) == NULL)
-        return NULL;
-    pg->latitude = strtod(param, NULL);
-
-    if (get_ns_hemisphere(cmd, param) == NULL)
+    if (nmea_sentence_type(cmd) != NMEA_GGA ||
+        decode_nmea(cmd, pg) != NMEA_GGA)
         return NULL;
-    pg->ns_hemisphere = param[0];
+    return pg;
+}
 
-    if (get_longitude(cmd, param) == NULL)
-        return NULL;
-    pg->longitude = strtod(param, NULL);
+/** \fn int read_gps_fix(int fd, gps_info *pg)
+ *
+ * Read and decode sentences until a GGA sentence brings
+ * a new fix.
+ * \param fd The serial port where GPS module is mounted.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns -1 on error, NMEA_GGA on success.
+ */
+int read_gps_fix(int fd, gps_info *pg) {
+    char buf[GPS_INFO_SIZE];
 
-    if (get_ew_hemisphere(cmd, param) == NULL)
-        return NULL;
-    pg->ew_hemisphere = param[0];
+    while (1) {
+        if (read_raw_gps(fd, buf) < 0)
+            return -1;
+        if (decode_nmea(buf, pg) == NMEA_GGA)
+            return NMEA_GGA;
+    }
+}
 
-    if (get_altitude(cmd, param) == NULL)
-        return NULL;
-    pg->altitude = strtod(param, NULL);
+/** \fn int poll_gps_fix(ring_reader *r, gps_info *pg)
+ *
+ * Decode every whole sentence buffered in a ring reader,
+ * without reading the port, for callers that read it from
+ * an event loop.
+ * \param r The ring reader of the GPS port.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns the number of GGA sentences decoded.
+ */
+int poll_gps_fix(ring_reader *r, gps_info *pg) {
+    char *line;
+    int cnt, fixes = 0;
 
-    return pg;
+    while ((line = ring_next_line(r, &cnt)) != NULL) {
+        if (cnt >= GPS_INFO_SIZE) {
+            stats.malformed++;
+            continue;
+        }
+        if (nmea_verify(line, cnt) == TRUE &&
+            decode_nmea(line, pg) == NMEA_GGA)
+            fixes++;
+    }
+    return fixes;
 }
 
 /** \fn void print_gps(const gps_info gps)
@@ -211,11 +546,44 @@ void print_gps(const gps_info gps) {
     else
         print_msg("South hemisphere.");
     print_msg("Longitude: %lf.", gps.longitude);
-    if (gps.ns_hemisphere == 'W')
+    if (gps.ew_hemisphere == 'W')
         print_msg("West hemisphere.");
     else
         print_msg("East hemisphere.");
     print_msg("Altitude: %lf.", gps.altitude);
+    print_msg("Fix quality: %d, fix type: %d, satellites: %d.",
+        gps.fix_quality, gps.fix_type, gps.satellites);
+    print_msg("DOP: p %.2lf, h %.2lf, v %.2lf.", 
+        gps.pdop, gps.hdop, gps.vdop);
+    print_msg("Speed: %.2lf km/h, course: %.2lf.", gps.speed, gps.course);
+}
+
+/** \fn double nmea_to_degree(double ddmm, char hemisphere)
+ *
+ * Convert a latitude or longitude in the ddmm.mmmm form of
+ * NMEA sentences to degrees.
+ * \param ddmm The latitude or longitude.
+ * \param hemisphere 'N', 'S', 'E' or 'W'.
+ * \return Returns the degrees, negative in the south and 
+ *         west hemispheres.
+ */
+double nmea_to_degree(double ddmm, char hemisphere) {
+    double deg = floor(ddmm / 100);
+
+    deg += (ddmm - deg * 100) / 60;
+    return (hemisphere == 'S' || hemisphere == 'W') ? -deg : deg;
+}
+
+/** \fn int64_t nmea_time_to_us(double hhmmss)
+ *
+ * Convert a UTC time in the hhmmss.sss form of NMEA
+ * sentences to microseconds since midnight.
+ */
+int64_t nmea_time_to_us(double hhmmss) {
+    long whole = (long)hhmmss;
+
+    return ((whole / 10000) * 3600 + (whole / 100 % 100) * 60 +
+        whole % 100) * 1000000LL + llround((hhmmss - whole) * 1e6);
 }
 
 /** \fn static double rad(double d)
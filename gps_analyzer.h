@@ -8,12 +8,30 @@
 #define _GPS_ANALYZER_H
 
 #include <stdlib.h>   // for strtod()
+#include <stdint.h>   // for uint64_t
 #include <string.h>   // for memset(), strncmp()
 #include "serial_port_config.h"
 #include "io_ops.h"
 
 // The size of a buffer storing GPS information.
 #define GPS_INFO_SIZE 100
+// The maximal number of fields in a sentence, the
+// GPGSV sentence has 20.
+#define NMEA_MAX_FIELDS 32
+// Field offsets are stored in a byte.
+#define NMEA_MAX_LENGTH 255
+
+// Sentences understood by decode_nmea(), from either
+// the GP (GPS) or the GN (multi-GNSS) talker.
+#define NMEA_UNKNOWN -1
+#define NMEA_GGA      0  /**< Fix data */
+#define NMEA_RMC      1  /**< Recommended minimum data */
+#define NMEA_GSA      2  /**< DOP and active satellites */
+#define NMEA_VTG      3  /**< Course and speed over ground */
+// The bit of a sentence in gps_info.updated.
+#define NMEA_BIT(type) (1u << (type))
+// The knot in km/h.
+#define KNOT_KMH      1.852
 #define PI            3.14159
 // The radius of earth. This value is used to 
 // calculate the distance between two points
@@ -30,19 +48,67 @@ typedef struct {
     double longitude;      /**< Longitude */
     char   ew_hemisphere;  /**< East or west hemisphere */
     double altitude;       /**< Altitude */
+    int    fix_quality;    /**< GGA fix quality, 0 for no fix */
+    int    satellites;     /**< Number of satellites in use */
+    double hdop;           /**< Horizontal dilution of precision */
+    double pdop;           /**< Position dilution of precision */
+    double vdop;           /**< Vertical dilution of precision */
+    int    fix_type;       /**< GSA fix type: 1 none, 2 2D, 3 3D */
+    char   status;         /**< RMC status, 'A' valid, 'V' warning */
+    int    date;           /**< RMC date as ddmmyy */
+    double speed;          /**< Speed over ground in km/h */
+    double course;         /**< Course over ground in degrees */
+    unsigned int updated;  /**< NMEA_BIT()s of decoded sentences */
 } gps_info;
 
+/** \typedef nmea_fields
+ * Offsets and lengths of the fields of a sentence, filled
+ * by a single pass of nmea_tokenize(). Field 0 is the
+ * address field, e.g., "$GPGGA". A field ends at a comma,
+ * the '*' of the checksum, or the end of the sentence.
+ */
+typedef struct {
+    const char    *sentence;                /**< The tokenized sentence */
+    int            count;                   /**< Number of fields */
+    unsigned char  offset[NMEA_MAX_FIELDS]; /**< Where each field begins */
+    unsigned char  length[NMEA_MAX_FIELDS]; /**< Length of each field */
+} nmea_fields;
+
+/** \typedef nmea_stats
+ * Counters of sentences accepted and rejected by
+ * read_raw_gps().
+ */
+typedef struct {
+    unsigned long accepted;      /**< Sentences with a valid checksum */
+    unsigned long bad_checksum;  /**< Checksum mismatches */
+    unsigned long no_checksum;   /**< Sentences without "*hh" */
+    unsigned long malformed;     /**< Over-long lines or no '$' */
+} nmea_stats;
+
 int read_raw_gps(int, char *);
+unsigned char nmea_xor(const char *, int);
+int nmea_verify(const char *, int);
+const nmea_stats *get_nmea_stats(void);
+void print_nmea_counters(const nmea_stats *);
+void print_nmea_stats(void);
 int is_gpgga(char *);
+int nmea_sentence_type(const char *);
+int decode_nmea(const char *, gps_info *);
 char *get_nth_parameter(char *, int, char *);
-char *get_utc_time(char *, char *);
-char *get_latitude(char *, char *);
-char *get_ns_hemisphere(char *, char *);
-char *get_longitude(char *, char *);
-char *get_ew_hemisphere(char *, char *);
-char *get_altitude(char *, char *);
+int nmea_tokenize(const char *, nmea_fields *);
+const char *nmea_field(const nmea_fields *, int, int *);
+const char *get_utc_time(const nmea_fields *, int *);
+const char *get_latitude(const nmea_fields *, int *);
+const char *get_ns_hemisphere(const nmea_fields *, int *);
+const char *get_longitude(const nmea_fields *, int *);
+const char *get_ew_hemisphere(const nmea_fields *, int *);
+const char *get_altitude(const nmea_fields *, int *);
 gps_info *get_gps_info(char *, gps_info *);
+int read_gps_fix(int, gps_info *);
+int poll_gps_fix(ring_reader *, gps_info *);
 void print_gps(const gps_info);
+double nmea_to_degree(double, char);
+int64_t nmea_time_to_us(double);
 static double rad(double);
 double get_distance(double, double, double, double);
 
@@ -0,0 +1,194 @@
+/** \file gps_tracker.c
+ *
+ * Function definitions for tracking the GPS module in a
+ * background thread.
+ *
+ * The thread is the only writer of the latest fix. It makes
+ * the sequence lock odd, copies the fix, and makes it even
+ * again. A reader copies the fix between two reads of the
+ * sequence lock and retries if they differ or are odd, so
+ * it never blocks, and retries only while a copy of a few
+ * hundred bytes is in progress. Half the sequence lock is
+ * the number of fixes published.
+ */
+
+#include <string.h>        // For memset().
+#include <unistd.h>        // For read(), write().
+#include <stdint.h>        // For uint64_t.
+#include <sys/eventfd.h>   // For eventfd().
+#include "header.h"
+#include "ubx.h"
+#include "lora_payload.h"
+#include "gps_tracker.h"
+
+/** \fn static void gps_tracker_publish(gps_tracker *t, const gps_info *pg, const struct timespec *stamp)
+ *
+ * Publish a fix to readers.
+ */
+static void gps_tracker_publish(gps_tracker *t, const gps_info *pg,
+    const struct timespec *stamp) {
+    unsigned long seq = t->seq;
+
+    __atomic_store_n(&t->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    t->fix = *pg;
+    t->stamp = *stamp;
+    ring_get_counters(get_ring_reader(t->fd), &t->ring);
+    t->nmea = *get_nmea_stats();
+    __atomic_store_n(&t->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/** \fn static void *gps_tracker_run(void *arg)
+ *
+ * Body of the tracker thread: read and publish fixes until
+ * the port fails.
+ */
+static void *gps_tracker_run(void *arg) {
+    gps_tracker *t = arg;
+    gps_info fix;
+    struct timespec stamp;
+    uint64_t one = 1;
+
+    memset(&fix, 0, sizeof(fix));
+    while ((t->ubx ? read_ubx_fix(t->fd, &fix) :
+        read_gps_fix(t->fd, &fix)) >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &stamp);
+        gps_tracker_publish(t, &fix, &stamp);
+        if (write(t->efd, &one, sizeof(one)) < 0)
+            break;
+    }
+    __atomic_store_n(&t->failed, TRUE, __ATOMIC_RELEASE);
+    // Wake up a waiting reader, which finds the failure.
+    if (write(t->efd, &one, sizeof(one)) < 0)
+        print_msg("fail to wake up gps tracker readers.");
+    return NULL;
+}
+
+/** \fn int gps_tracker_start(gps_tracker *t, int fd, int ubx)
+ *
+ * Start tracking a GPS module.
+ * \param t The tracker.
+ * \param fd The GPS serial port, which should be blocking.
+ * \param ubx Whether the GPS module is in UBX mode.
+ * \return Returns -1 on error, 0 on success.
+ */
+int gps_tracker_start(gps_tracker *t, int fd, int ubx) {
+    memset(t, 0, sizeof(*t));
+    t->fd = fd;
+    t->ubx = ubx;
+    if ((t->efd = eventfd(0, 0)) < 0)
+        return ERROR;
+    if (pthread_create(&t->thread, NULL, gps_tracker_run, t) != 0) {
+        close(t->efd);
+        return ERROR;
+    }
+    return OK;
+}
+
+/** \fn unsigned long gps_tracker_get(gps_tracker *t, gps_info *pg, struct timespec *stamp)
+ *
+ * Copy the latest fix without blocking.
+ * \param t The tracker.
+ * \param pg Where to store the fix.
+ * \param stamp Where to store when the fix was read, or
+ *        NULL.
+ * \return Returns the number of fixes published so far, 0
+ *         if there is no fix yet, in which case pg is
+ *         zeroed.
+ */
+unsigned long gps_tracker_get(gps_tracker *t, gps_info *pg,
+    struct timespec *stamp) {
+    unsigned long begin, end;
+    struct timespec ts;
+
+    do {
+        begin = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+        *pg = t->fix;
+        ts = t->stamp;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+    } while (begin != end || (begin & 1));
+    if (stamp != NULL)
+        *stamp = ts;
+    return begin / 2;
+}
+
+/** \fn unsigned long gps_tracker_wait(gps_tracker *t, gps_info *pg, struct timespec *stamp)
+ *
+ * Wait until the tracker publishes fixes not waited for
+ * yet, and copy the latest one.
+ * \param t The tracker.
+ * \param pg Where to store the fix.
+ * \param stamp Where to store when the fix was read, or
+ *        NULL.
+ * \return Returns 0 if the tracker failed, or the number
+ *         of fixes published so far.
+ */
+unsigned long gps_tracker_wait(gps_tracker *t, gps_info *pg,
+    struct timespec *stamp) {
+    uint64_t n;
+
+    while (read(t->efd, &n, sizeof(n)) < 0)
+        if (errno != EINTR)
+            return 0;
+    if (gps_tracker_failed(t))
+        return 0;
+    return gps_tracker_get(t, pg, stamp);
+}
+
+/** \fn unsigned long gps_tracker_counters(gps_tracker *t, ring_counters *ring, nmea_stats *nmea)
+ *
+ * Copy the counters of the GPS port as of the latest fix,
+ * without blocking. The tracker thread updates them, so
+ * they are not read from the port's ring reader and the
+ * NMEA statistics directly.
+ * \param t The tracker.
+ * \param ring Where to store the counters of the port.
+ * \param nmea Where to store the NMEA counters.
+ * \return Returns the number of fixes published so far.
+ */
+unsigned long gps_tracker_counters(gps_tracker *t, ring_counters *ring,
+    nmea_stats *nmea) {
+    unsigned long begin, end;
+
+    do {
+        begin = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+        *ring = t->ring;
+        *nmea = t->nmea;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+    } while (begin != end || (begin & 1));
+    return begin / 2;
+}
+
+/** \fn int gps_tracker_failed(gps_tracker *t)
+ *
+ * Whether the tracker thread stopped on a read error.
+ */
+int gps_tracker_failed(gps_tracker *t) {
+    return __atomic_load_n(&t->failed, __ATOMIC_ACQUIRE);
+}
+
+/** \fn int64_t gps_tracker_utc(gps_tracker *t, const struct timespec *now)
+ *
+ * Get the GPS time of day, i.e., the UTC time of the
+ * latest fix plus the time elapsed since it was read. Two
+ * hosts with GPS modules get the same time, up to the
+ * output delay of their modules.
+ * \param t The tracker.
+ * \param now The current time on CLOCK_MONOTONIC.
+ * \return Returns -1 without a fix, or the microseconds
+ *         since UTC midnight.
+ */
+int64_t gps_tracker_utc(gps_tracker *t, const struct timespec *now) {
+    gps_info fix;
+    struct timespec stamp;
+    int64_t us;
+
+    if (gps_tracker_get(t, &fix, &stamp) == 0 || fix.fix_quality == 0)
+        return -1;
+    us = nmea_time_to_us(fix.utc_time);
+    us += (now->tv_sec - stamp.tv_sec) * 1000000LL +
+        (now->tv_nsec - stamp.tv_nsec) / 1000;
+    return us % (MS_PER_DAY * 1000LL);
+}
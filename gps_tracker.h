@@ -0,0 +1,43 @@
+/** \file gps_tracker.h
+ *
+ * Type definitions and function declarations for tracking
+ * the GPS module in a background thread.
+ */
+
+#ifndef _GPS_TRACKER_H
+#define _GPS_TRACKER_H
+
+#include <pthread.h>         // For the tracker thread.
+#include <stdint.h>          // For fixed width integers.
+#include <time.h>            // For struct timespec.
+#include "gps_analyzer.h"    // gps_info.
+
+/** \typedef gps_tracker
+ * A thread reading the GPS module continuously, and
+ * publishing the latest fix through a sequence lock, so
+ * that readers never wait on the serial port or on the
+ * thread. The counters of the port, which the thread
+ * updates, are published along with the fix.
+ */
+typedef struct {
+    int             fd;       /**< The GPS serial port */
+    int             ubx;      /**< Whether the module is in UBX mode */
+    int             efd;      /**< eventfd signalled on every fix */
+    pthread_t       thread;   /**< The tracker thread */
+    unsigned long   seq;      /**< Sequence lock, odd while writing */
+    int             failed;   /**< Whether the thread stopped on error */
+    gps_info        fix;      /**< The latest fix */
+    struct timespec stamp;    /**< When the latest fix was read, on
+                                   CLOCK_MONOTONIC */
+    ring_counters   ring;     /**< Counters of the port at the latest fix */
+    nmea_stats      nmea;     /**< NMEA counters at the latest fix */
+} gps_tracker;
+
+int gps_tracker_start(gps_tracker *, int, int);
+unsigned long gps_tracker_get(gps_tracker *, gps_info *, struct timespec *);
+unsigned long gps_tracker_wait(gps_tracker *, gps_info *, struct timespec *);
+unsigned long gps_tracker_counters(gps_tracker *, ring_counters *, nmea_stats *);
+int gps_tracker_failed(gps_tracker *);
+int64_t gps_tracker_utc(gps_tracker *, const struct timespec *);
+
+#endif
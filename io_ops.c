@@ -1,27 +1,33 @@
+#include <string.h>
 #include "io_ops.h"
 #include "header.h"
 
+// Ring readers handed out by get_ring_reader(), indexed by descriptor.
+static ring_reader *readers[RING_MAX_FD];
+
 int read_a_char(int fd) {
-    char ch;
-    read(fd, &ch, 1);
+    ring_reader *r;
+    char *ch;
+
+    if ((r = get_ring_reader(fd)) == NULL ||
+        (ch = ring_read_frame(r, 1)) == NULL)
+        return ERROR;
 
-    return ch;
+    return *ch;
 }
 
 int read_line(int fd, char *buf, int size) {
-    int i;
-    for (i = 0; i < size - 1; i++) {
-    again:
-        if (read(fd, buf + i, 1) < 0)
-            if (errno == EINTR)
-                goto again;
-        if (*(buf + i) == '\n')
-            break;
-    }
-    if (*(buf + i) != '\n')
-        return -1;
-    *(buf + i) = '\0';
-    return i;
+    ring_reader *r;
+    char *line;
+    int len;
+
+    if ((r = get_ring_reader(fd)) == NULL ||
+        (line = ring_read_line(r, &len)) == NULL)
+        return ERROR;
+    if (len >= size)
+        return ERROR;
+    memcpy(buf, line, len + 1);
+    return len;
 }
 
 int getline_fd(int fd, char *buf) {
@@ -32,6 +38,330 @@ int getline_fd(int fd, char *buf) {
     return cnt;
 }
 
+/** \fn int write_all(int fd, const void *buf, int len)
+ *
+ * Write a whole buffer, normally with a single write().
+ * If the descriptor is non-blocking and its output queue
+ * is full, wait until it can be written again.
+ * \param fd The descriptor.
+ * \param buf The buffer.
+ * \param len The number of bytes.
+ * \return Returns -1 on error, or len on success.
+ */
+int write_all(int fd, const void *buf, int len) {
+    struct pollfd pfd;
+    int cnt = 0, n;
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    while (cnt < len) {
+        if ((n = write(fd, (const char *)buf + cnt, len - cnt)) >= 0) {
+            cnt += n;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return ERROR;
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            return ERROR;
+    }
+    return len;
+}
+
+/** \fn int set_nonblock(int fd)
+ *
+ * Make a descriptor non-blocking, so that it can be served
+ * from an event loop.
+ * \param fd The descriptor.
+ * \return Returns -1 on error, 0 on success.
+ */
+int set_nonblock(int fd) {
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL)) < 0 ||
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return ERROR;
+    return OK;
+}
+
+/** \fn ring_reader *ring_reader_init(ring_reader *r, int fd)
+ *
+ * Initialize a ring reader on a given descriptor.
+ * \param r The ring reader.
+ * \param fd The descriptor to be read, e.g., an open
+ *        serial port.
+ * \return Always returns the given ring reader.
+ */
+ring_reader *ring_reader_init(ring_reader *r, int fd) {
+    r->fd = fd;
+    r->head = 0;
+    r->tail = 0;
+    r->nread = 0;
+    r->nbytes = 0;
+    r->nlines = 0;
+    r->ndropped = 0;
+    return r;
+}
+
+/** \fn ring_reader *get_ring_reader(int fd)
+ *
+ * Get the ring reader bound to a descriptor, creating it on
+ * first use. All byte and line reads on the same descriptor
+ * should go through this reader, otherwise bytes already
+ * buffered in the ring are skipped.
+ * \param fd The descriptor.
+ * \return Returns NULL on error, or the ring reader on success.
+ */
+ring_reader *get_ring_reader(int fd) {
+    if (fd < 0 || fd >= RING_MAX_FD)
+        error_return_null("no ring reader for descriptor %d.", fd);
+    if (readers[fd] == NULL) {
+        if ((readers[fd] = malloc(sizeof(ring_reader))) == NULL)
+            error_return_null("fail to allocate ring reader.");
+        ring_reader_init(readers[fd], fd);
+    }
+    return readers[fd];
+}
+
+/** \fn int ring_fill(ring_reader *r)
+ *
+ * Fill the free space of a ring reader with a single
+ * read() call, which blocks if the descriptor does.
+ * \param r The ring reader.
+ * \return Returns -1 on error or when the ring is full,
+ *         0 on end of file, or the number of bytes read.
+ */
+int ring_fill(ring_reader *r) {
+    unsigned int pos = r->tail & (RING_SIZE - 1);
+    unsigned int room = RING_SIZE - (r->tail - r->head);
+    int n;
+
+    if (room == 0) {
+        errno = ENOBUFS;
+        return ERROR;
+    }
+    // Only the contiguous part up to the end of the ring
+    // is read, the rest is read by the next call.
+    if (room > RING_SIZE - pos)
+        room = RING_SIZE - pos;
+again:
+    r->nread++;
+    if ((n = read(r->fd, r->data + pos, room)) < 0) {
+        if (errno == EINTR)
+            goto again;
+        return ERROR;
+    }
+    r->tail += n;
+    r->nbytes += n;
+    return n;
+}
+
+/** \fn int ring_fill_timeout(ring_reader *r, int timeout)
+ *
+ * Wait for input up to a timeout, then fill the ring as
+ * ring_fill() does.
+ * \param r The ring reader.
+ * \param timeout The timeout in milliseconds, -1 for none.
+ * \return Returns -1 on error or timeout, in which case errno
+ *         is ETIMEDOUT, 0 on end of file, or the number of 
+ *         bytes read.
+ */
+int ring_fill_timeout(ring_reader *r, int timeout) {
+    struct pollfd pfd;
+    int n;
+
+    pfd.fd = r->fd;
+    pfd.events = POLLIN;
+again:
+    if ((n = poll(&pfd, 1, timeout)) < 0) {
+        if (errno == EINTR)
+            goto again;
+        return ERROR;
+    }
+    if (n == 0) {
+        errno = ETIMEDOUT;
+        return ERROR;
+    }
+    return ring_fill(r);
+}
+
+/** \fn int ring_available(const ring_reader *r)
+ *
+ * Get the number of buffered bytes not consumed yet.
+ */
+int ring_available(const ring_reader *r) {
+    return r->tail - r->head;
+}
+
+/** \fn char *ring_next_line(ring_reader *r, int *len)
+ *
+ * Take the next complete line out of the ring without
+ * reading the descriptor. The line feed, and a carriage
+ * return before it, are replaced by '\0'. Lines longer 
+ * than RING_MAX_LINE are dropped.
+ * \param r The ring reader.
+ * \param len Where to store the length of the line.
+ * \return Returns NULL if no complete line is buffered, or
+ *         the line, which is a slice of the ring valid until
+ *         the next call on this reader.
+ */
+char *ring_next_line(ring_reader *r, int *len) {
+    unsigned int used, start, first;
+    char *nl, *line;
+    int n;
+
+    while ((used = r->tail - r->head) > 0) {
+        start = r->head & (RING_SIZE - 1);
+        first = RING_SIZE - start;
+        if (first > used)
+            first = used;
+
+        // Search the part before the end of the ring, then
+        // the part wrapped to its beginning.
+        if ((nl = memchr(r->data + start, '\n', first)) != NULL)
+            n = nl - (r->data + start);
+        else if (used > first && 
+            (nl = memchr(r->data, '\n', used - first)) != NULL)
+            n = first + (nl - r->data);
+        else {
+            if (used < RING_MAX_LINE)
+                return NULL;
+            r->head += used;
+            r->ndropped += used;
+            continue;
+        }
+
+        if (n >= RING_MAX_LINE) {
+            r->head += n + 1;
+            r->ndropped += n + 1;
+            continue;
+        }
+
+        // Mirror the wrapped part into the spill area.
+        if (start + n >= RING_SIZE)
+            memcpy(r->data + RING_SIZE, r->data, start + n + 1 - RING_SIZE);
+        line = r->data + start;
+        r->head += n + 1;
+        r->nlines++;
+
+        if (n > 0 && line[n - 1] == '\r')
+            n--;
+        line[n] = '\0';
+        *len = n;
+        return line;
+    }
+    return NULL;
+}
+
+/** \fn char *ring_read_line(ring_reader *r, int *len)
+ *
+ * Read the next line, filling the ring as needed.
+ * \param r The ring reader.
+ * \param len Where to store the length of the line.
+ * \return Returns NULL on error or end of file, or the line
+ *         as returned by ring_next_line().
+ */
+char *ring_read_line(ring_reader *r, int *len) {
+    char *line;
+
+    while ((line = ring_next_line(r, len)) == NULL)
+        if (ring_fill(r) <= 0)
+            return NULL;
+    return line;
+}
+
+/** \fn char *ring_peek(ring_reader *r, int n)
+ *
+ * Look at the next n bytes without taking them out of
+ * the ring.
+ * \param r The ring reader.
+ * \param n The number of bytes, at most RING_MAX_LINE.
+ * \return Returns NULL if fewer than n bytes are buffered, or
+ *         the bytes, which are a slice of the ring valid until
+ *         the next call on this reader.
+ */
+char *ring_peek(ring_reader *r, int n) {
+    unsigned int start = r->head & (RING_SIZE - 1);
+
+    if (n <= 0 || n > RING_MAX_LINE || r->tail - r->head < (unsigned int)n)
+        return NULL;
+    if (start + n > RING_SIZE)
+        memcpy(r->data + RING_SIZE, r->data, start + n - RING_SIZE);
+    return r->data + start;
+}
+
+/** \fn char *ring_next_frame(ring_reader *r, int n)
+ *
+ * Take the next n bytes out of the ring without reading the
+ * descriptor.
+ * \param r The ring reader.
+ * \param n The frame length, at most RING_MAX_LINE.
+ * \return Returns NULL if fewer than n bytes are buffered, or
+ *         the frame, which is a slice of the ring valid until
+ *         the next call on this reader.
+ */
+char *ring_next_frame(ring_reader *r, int n) {
+    char *frame;
+
+    if ((frame = ring_peek(r, n)) != NULL)
+        r->head += n;
+    return frame;
+}
+
+/** \fn char *ring_read_frame(ring_reader *r, int n)
+ *
+ * Read the next n bytes, filling the ring as needed.
+ * \return Returns NULL on error or end of file, or the frame
+ *         as returned by ring_next_frame().
+ */
+char *ring_read_frame(ring_reader *r, int n) {
+    char *frame;
+
+    if (n <= 0 || n > RING_MAX_LINE)
+        return NULL;
+    while ((frame = ring_next_frame(r, n)) == NULL)
+        if (ring_fill(r) <= 0)
+            return NULL;
+    return frame;
+}
+
+/** \fn void ring_get_counters(const ring_reader *r, ring_counters *c)
+ *
+ * Copy the counters of a ring reader.
+ */
+void ring_get_counters(const ring_reader *r, ring_counters *c) {
+    c->fd = r->fd;
+    c->nread = r->nread;
+    c->nbytes = r->nbytes;
+    c->nlines = r->nlines;
+    c->ndropped = r->ndropped;
+}
+
+/** \fn void print_ring_counters(const ring_counters *c)
+ *
+ * Print the number of read() calls issued per line, which
+ * was one per byte before the ring reader.
+ */
+void print_ring_counters(const ring_counters *c) {
+    print_msg("fd %d: %lu read() calls, %lu bytes, %lu lines, "
+              "%.2lf calls per line, %lu bytes dropped.",
+        c->fd, c->nread, c->nbytes, c->nlines,
+        c->nlines ? (double)c->nread / c->nlines : 0.0, c->ndropped);
+}
+
+/** \fn void print_ring_stats(const ring_reader *r)
+ *
+ * Print the counters of a ring reader, from the thread
+ * reading the port.
+ */
+void print_ring_stats(const ring_reader *r) {
+    ring_counters c;
+
+    ring_get_counters(r, &c);
+    print_ring_counters(&c);
+}
+
 int init_epoll(int rset[], int rnum, int wset[], int wnum) {
     int epfd;
 
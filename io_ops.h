@@ -6,9 +6,49 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/epoll.h>   // Multiplexing I/O using epoll functions.
+#include <poll.h>        // Waiting for input with a timeout.
 
 #define BUF_SIZE 100
 
+#define RING_SIZE     4096  /**< Capacity of a ring reader, a power of 2. */
+#define RING_MAX_LINE 256   /**< The longest line or frame handed back
+                             * as a single slice. Bytes belonging to a
+                             * slice that wraps around the end of the
+                             * ring are mirrored into a spill area of
+                             * this size right behind the ring, so that
+                             * every slice is contiguous.
+                             */
+#define RING_MAX_FD   64    /**< Descriptors served by get_ring_reader(). */
+
+/** \typedef ring_reader
+ * A buffered reader of a serial port. The ring is filled
+ * by large read() calls and lines or frames are handed back
+ * as slices of the ring, which stay valid until the next
+ * call on the same reader.
+ */
+typedef struct {
+    int           fd;         /**< The descriptor being read */
+    unsigned int  head;       /**< Read position, never wrapped */
+    unsigned int  tail;       /**< Write position, never wrapped */
+    unsigned long nread;      /**< Number of read() calls issued */
+    unsigned long nbytes;     /**< Number of bytes read */
+    unsigned long nlines;     /**< Number of lines handed back */
+    unsigned long ndropped;   /**< Bytes dropped in over-long lines */
+    char          data[RING_SIZE + RING_MAX_LINE + 1];
+} ring_reader;
+
+/** \typedef ring_counters
+ * A copy of the counters of a ring reader, for a thread
+ * other than the one reading the port.
+ */
+typedef struct {
+    int           fd;         /**< The descriptor being read */
+    unsigned long nread;      /**< Number of read() calls issued */
+    unsigned long nbytes;     /**< Number of bytes read */
+    unsigned long nlines;     /**< Number of lines handed back */
+    unsigned long ndropped;   /**< Bytes dropped in over-long lines */
+} ring_counters;
+
 int read_a_char(int);
 int getline_fd(int, char *);
 int add_epoll_read_event(int, int);
@@ -19,5 +59,20 @@ int modify_epoll_to_read_event(int, int);
 int modify_epoll_to_write_event(int, int);
 int init_epoll(int [], int, int [], int);
 int read_line(int, char *, int);
+int write_all(int, const void *, int);
+int set_nonblock(int);
+ring_reader *ring_reader_init(ring_reader *, int);
+ring_reader *get_ring_reader(int);
+int ring_fill(ring_reader *);
+int ring_fill_timeout(ring_reader *, int);
+int ring_available(const ring_reader *);
+char *ring_next_line(ring_reader *, int *);
+char *ring_read_line(ring_reader *, int *);
+char *ring_peek(ring_reader *, int);
+char *ring_next_frame(ring_reader *, int);
+char *ring_read_frame(ring_reader *, int);
+void ring_get_counters(const ring_reader *, ring_counters *);
+void print_ring_counters(const ring_counters *);
+void print_ring_stats(const ring_reader *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/** \file latency_hist.c
+ *
+ * Function definitions for latency histograms.
+ */
+
+#include <string.h>          // For memset().
+#include "header.h"
+#include "latency_hist.h"
+
+/** \fn void latency_hist_clear(latency_hist *h)
+ *
+ * Empty a histogram.
+ */
+void latency_hist_clear(latency_hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/** \fn static int hist_index(uint64_t v)
+ *
+ * Get the bucket of a value within the range.
+ */
+static int hist_index(uint64_t v) {
+    int msb;
+
+    if (v < HIST_SUB)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+        ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/** \fn static int64_t hist_value(int i)
+ *
+ * Get the middle value of a bucket.
+ */
+static int64_t hist_value(int i) {
+    int shift = i / HIST_SUB - 1;
+
+    if (shift < 0)
+        return i;
+    return ((int64_t)(HIST_SUB + i % HIST_SUB) << shift) +
+        ((int64_t)1 << shift) / 2;
+}
+
+/** \fn void latency_hist_record(latency_hist *h, int64_t v)
+ *
+ * Record a latency.
+ * \param h The histogram.
+ * \param v The latency in microseconds.
+ */
+void latency_hist_record(latency_hist *h, int64_t v) {
+    if (h->count == 0 || v < h->min)
+        h->min = v;
+    if (h->count == 0 || v > h->max)
+        h->max = v;
+    h->count++;
+    h->sum += v;
+    if (v < 0) {
+        h->negative++;
+        v = 0;
+    } else if (v >= (int64_t)1 << HIST_MAX_BITS) {
+        h->overflow++;
+        v = ((int64_t)1 << HIST_MAX_BITS) - 1;
+    }
+    h->buckets[hist_index(v)]++;
+}
+
+/** \fn void latency_hist_add(latency_hist *sum, const latency_hist *h)
+ *
+ * Add a histogram to a sum.
+ */
+void latency_hist_add(latency_hist *sum, const latency_hist *h) {
+    if (h->count == 0)
+        return;
+    if (sum->count == 0 || h->min < sum->min)
+        sum->min = h->min;
+    if (sum->count == 0 || h->max > sum->max)
+        sum->max = h->max;
+    sum->count += h->count;
+    sum->negative += h->negative;
+    sum->overflow += h->overflow;
+    sum->sum += h->sum;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        sum->buckets[i] += h->buckets[i];
+}
+
+/** \fn int64_t latency_hist_percentile(const latency_hist *h, double p)
+ *
+ * Get a percentile of the values recorded.
+ * \param h The histogram.
+ * \param p The percentile, e.g., 99.9.
+ * \return Returns the value of the bucket holding the
+ *         percentile, 0 if the histogram is empty.
+ */
+int64_t latency_hist_percentile(const latency_hist *h, double p) {
+    uint64_t rank = (uint64_t)(h->count * p / 100.0 + 0.5), seen = 0;
+    int64_t v;
+
+    if (h->count == 0)
+        return 0;
+    if (rank < 1)
+        rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if ((seen += h->buckets[i]) >= rank) {
+            // The middle of the bucket, within the extremes.
+            v = hist_value(i);
+            return v < h->min ? h->min : v > h->max ? h->max : v;
+        }
+    return h->max;
+}
+
+/** \fn void print_latency_hist(const char *label, const latency_hist *h)
+ *
+ * Print the percentiles of a histogram in milliseconds.
+ */
+void print_latency_hist(const char *label, const latency_hist *h) {
+    if (h->count == 0)
+        return;
+    print_msg("%s latency: %lu packets, min %.1lf ms, mean %.1lf ms, "
+              "p50 %.1lf ms, p99 %.1lf ms, p99.9 %.1lf ms, max %.1lf ms"
+              "%s",
+        label, (unsigned long)h->count, h->min / 1e3, h->sum / h->count / 1e3,
+        latency_hist_percentile(h, 50) / 1e3,
+        latency_hist_percentile(h, 99) / 1e3,
+        latency_hist_percentile(h, 99.9) / 1e3, h->max / 1e3,
+        h->negative ? " (clocks apart, some below 0)" : "");
+}
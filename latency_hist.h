@@ -0,0 +1,40 @@
+/** \file latency_hist.h
+ *
+ * Type definitions and function declarations for latency
+ * histograms.
+ */
+
+#ifndef _LATENCY_HIST_H
+#define _LATENCY_HIST_H
+
+#include <stdint.h>          // For fixed width integers.
+
+#define HIST_SUB_BITS  5     //< 32 buckets per power of 2, about 3% wide.
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS  27    //< Values up to 2^27 us, over 2 minutes.
+#define HIST_BUCKETS   (HIST_SUB * (HIST_MAX_BITS - HIST_SUB_BITS + 1))
+
+/** \typedef latency_hist
+ * A log-linear histogram of latencies in microseconds, as
+ * in HdrHistogram: values below HIST_SUB have a bucket of
+ * their own, and each power of 2 above is split into
+ * HIST_SUB buckets, so that the relative error is constant
+ * and recording is a shift and an increment.
+ */
+typedef struct {
+    uint64_t      count;        /**< Values recorded */
+    uint64_t      negative;     /**< Values below 0, recorded as 0 */
+    uint64_t      overflow;     /**< Values above the range, as the top */
+    int64_t       min;          /**< The smallest value */
+    int64_t       max;          /**< The largest value */
+    double        sum;          /**< Sum of values, for the mean */
+    uint32_t      buckets[HIST_BUCKETS];
+} latency_hist;
+
+void latency_hist_clear(latency_hist *);
+void latency_hist_record(latency_hist *, int64_t);
+void latency_hist_add(latency_hist *, const latency_hist *);
+int64_t latency_hist_percentile(const latency_hist *, double);
+void print_latency_hist(const char *, const latency_hist *);
+
+#endif
@@ -0,0 +1,243 @@
+/** \file link_stats.c
+ *
+ * Function definitions for windowed statistics of a LoRa
+ * link: packet reception rate, goodput, inter-arrival
+ * times and bursts of lost packets.
+ *
+ * Packets are classified by a seq_tracker. A packet in
+ * order that skips n sequence numbers means n packets lost
+ * in a burst, and a reordered packet gives one back if its
+ * loss was counted in the same window.
+ */
+
+#include <math.h>            // For sqrt().
+#include <stdlib.h>          // For calloc(), free().
+#include <string.h>          // For memset().
+#include "header.h"
+#include "seq_tracker.h"
+#include "link_stats.h"
+
+/** \fn void stats_counters_clear(stats_counters *c)
+ *
+ * Reset counters.
+ */
+void stats_counters_clear(stats_counters *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+/** \fn void stats_counters_add(stats_counters *sum, const stats_counters *c)
+ *
+ * Add counters to a sum.
+ */
+void stats_counters_add(stats_counters *sum, const stats_counters *c) {
+    if (c->gaps > 0) {
+        if (sum->gaps == 0 || c->gap_min < sum->gap_min)
+            sum->gap_min = c->gap_min;
+        if (c->gap_max > sum->gap_max)
+            sum->gap_max = c->gap_max;
+    }
+    sum->packets += c->packets;
+    sum->reordered += c->reordered;
+    sum->duplicates += c->duplicates;
+    sum->late += c->late;
+    sum->expected += c->expected;
+    sum->lost += c->lost;
+    sum->bytes += c->bytes;
+    sum->bursts += c->bursts;
+    if (c->burst_max > sum->burst_max)
+        sum->burst_max = c->burst_max;
+    sum->gaps += c->gaps;
+    sum->gap_sum += c->gap_sum;
+    sum->gap_sq += c->gap_sq;
+}
+
+/** \fn int link_stats_init(link_stats *ls, int tumbling, int sliding, const struct timespec *now)
+ *
+ * Initialize the statistics of a link, allocating the
+ * buckets of its sliding window.
+ * \param ls The statistics.
+ * \param tumbling Seconds per tumbling window.
+ * \param sliding Seconds per sliding window, at most
+ *        STATS_MAX_BUCKETS.
+ * \param now The current time on CLOCK_MONOTONIC.
+ * \return Returns -1 on error, 0 on success.
+ */
+int link_stats_init(link_stats *ls, int tumbling, int sliding,
+    const struct timespec *now) {
+    memset(ls, 0, sizeof(*ls));
+    ls->tumbling = tumbling > 0 ? tumbling : 1;
+    ls->sliding = sliding < 1 ? 1 :
+        sliding > STATS_MAX_BUCKETS ? STATS_MAX_BUCKETS : sliding;
+    ls->origin = *now;
+    if ((ls->buckets = calloc(ls->sliding, sizeof(stats_counters))) == NULL)
+        return ERROR;
+    return OK;
+}
+
+/** \fn void link_stats_free(link_stats *ls)
+ *
+ * Free the buckets of the sliding window of a link.
+ */
+void link_stats_free(link_stats *ls) {
+    free(ls->buckets);
+    ls->buckets = NULL;
+}
+
+/** \fn int link_stats_advance(link_stats *ls, const struct timespec *now)
+ *
+ * Move the windows to the current time, clearing the
+ * buckets of the seconds that left the sliding window.
+ * \param ls The statistics.
+ * \param now The current time on CLOCK_MONOTONIC.
+ * \return Returns TRUE if the tumbling window is over, in
+ *         which case the caller takes it with
+ *         link_stats_rotate(), FALSE otherwise.
+ */
+int link_stats_advance(link_stats *ls, const struct timespec *now) {
+    long second = now->tv_sec - ls->origin.tv_sec -
+        (now->tv_nsec < ls->origin.tv_nsec);
+    long n = second - ls->second;
+
+    // A bucket is cleared once per second, whatever the
+    // number of packets.
+    if (n > ls->sliding)
+        n = ls->sliding;
+    for (long i = 1; i <= n; i++)
+        stats_counters_clear(&ls->buckets[(second - n + i) % ls->sliding]);
+    if (second > ls->second)
+        ls->second = second;
+    return ls->second - ls->window >= ls->tumbling;
+}
+
+/** \fn int link_stats_rotate(link_stats *ls, stats_counters *window)
+ *
+ * Take the counters of the tumbling window, and start a
+ * new one.
+ * \param ls The statistics.
+ * \param window Where to store the counters.
+ * \return Returns the length of the window in seconds.
+ */
+int link_stats_rotate(link_stats *ls, stats_counters *window) {
+    int seconds = ls->second - ls->window;
+
+    *window = ls->current;
+    stats_counters_clear(&ls->current);
+    ls->window = ls->second;
+    return seconds;
+}
+
+/** \fn static void count_packet(stats_counters *c, double gap, int type, uint32_t lost, int bytes)
+ *
+ * Count a packet in some counters.
+ */
+static void count_packet(stats_counters *c, double gap, int type,
+    uint32_t lost, int bytes) {
+    switch (type) {
+        case SEQ_IN_ORDER:
+        case SEQ_RESTART:
+            c->packets++;
+            c->expected += lost + 1;
+            c->lost += lost;
+            if (lost > 0) {
+                c->bursts++;
+                if (lost > c->burst_max)
+                    c->burst_max = lost;
+            }
+            break;
+        case SEQ_REORDERED:
+            c->packets++;
+            c->reordered++;
+            if (c->lost > 0)
+                c->lost--;
+            else
+                c->expected++;
+            break;
+        case SEQ_DUPLICATE:
+            c->duplicates++;
+            break;
+        default:
+            c->late++;
+    }
+    c->bytes += bytes;
+    if (gap < 0)
+        return;
+    if (c->gaps == 0 || gap < c->gap_min)
+        c->gap_min = gap;
+    if (gap > c->gap_max)
+        c->gap_max = gap;
+    c->gaps++;
+    c->gap_sum += gap;
+    c->gap_sq += gap * gap;
+}
+
+/** \fn void link_stats_packet(link_stats *ls, const struct timespec *now, int type, uint32_t skipped, int bytes)
+ *
+ * Count a packet received on a link.
+ * \param ls The statistics.
+ * \param now When the packet was received, on
+ *        CLOCK_MONOTONIC.
+ * \param type What the packet is, as returned by
+ *        seq_tracker_update().
+ * \param skipped The sequence numbers skipped by the packet.
+ * \param bytes The payload length.
+ */
+void link_stats_packet(link_stats *ls, const struct timespec *now,
+    int type, uint32_t skipped, int bytes) {
+    double gap = -1;
+
+    link_stats_advance(ls, now);
+    if (ls->started)
+        gap = (now->tv_sec - ls->arrival.tv_sec) +
+            (now->tv_nsec - ls->arrival.tv_nsec) / 1e9;
+    ls->started = TRUE;
+    ls->arrival = *now;
+    count_packet(&ls->current, gap, type, skipped, bytes);
+    count_packet(&ls->buckets[ls->second % ls->sliding], gap, type,
+        skipped, bytes);
+}
+
+/** \fn void link_stats_sliding(const link_stats *ls, stats_counters *sum)
+ *
+ * Sum the buckets of the sliding window.
+ */
+void link_stats_sliding(const link_stats *ls, stats_counters *sum) {
+    stats_counters_clear(sum);
+    for (int i = 0; i < ls->sliding; i++)
+        stats_counters_add(sum, &ls->buckets[i]);
+}
+
+/** \fn int link_stats_timeout(const struct timespec *origin, const struct timespec *now)
+ *
+ * Get the time until the next second of statistics that
+ * started at origin, as an epoll or poll timeout.
+ * \return Returns the timeout in milliseconds.
+ */
+int link_stats_timeout(const struct timespec *origin, const struct timespec *now) {
+    long ns = (now->tv_nsec - origin->tv_nsec + 1000000000L) % 1000000000L;
+
+    return (1000000000L - ns) / 1000000 + 1;
+}
+
+/** \fn void print_stats_counters(const char *label, const stats_counters *c, double seconds)
+ *
+ * Print the statistics of a window.
+ * \param label What the window is, e.g., the port name.
+ * \param c The counters of the window.
+ * \param seconds The length of the window.
+ */
+void print_stats_counters(const char *label, const stats_counters *c,
+    double seconds) {
+    double mean = c->gaps ? c->gap_sum / c->gaps : 0;
+    double var = c->gaps ? c->gap_sq / c->gaps - mean * mean : 0;
+
+    print_msg("%s: \033[47;31mPRR: %.2lf%%\033[0m (%lu/%lu, %lu reordered, "
+              "%lu duplicates, %lu late), "
+              "goodput: %.1lf B/s, loss bursts: %lu (longest %lu), "
+              "inter-arrival: mean %.3lf s, sd %.3lf s, min %.3lf s, "
+              "max %.3lf s",
+        label, c->expected ? 100.0 * c->packets / c->expected : 0.0,
+        c->packets, c->expected, c->reordered, c->duplicates, c->late,
+        c->bytes / seconds,
+        c->bursts, c->burst_max, mean, var > 0 ? sqrt(var) : 0.0,
+        c->gap_min, c->gap_max);
+}
@@ -0,0 +1,69 @@
+/** \file link_stats.h
+ *
+ * Type definitions and function declarations for windowed
+ * statistics of a LoRa link.
+ */
+
+#ifndef _LINK_STATS_H
+#define _LINK_STATS_H
+
+#include <stdint.h>          // For fixed width integers.
+#include <time.h>            // For struct timespec.
+
+#define STATS_MAX_BUCKETS 300   //< The longest sliding window in seconds.
+#define TUMBLING_WINDOW   20    //< Default seconds per statistics report.
+#define SLIDING_WINDOW    60    //< Default seconds of the sliding statistics.
+
+/** \typedef stats_counters
+ * Counters of the packets of a link over some time.
+ */
+typedef struct {
+    unsigned long packets;    /**< Distinct packets received */
+    unsigned long reordered;  /**< Packets that filled a gap */
+    unsigned long duplicates; /**< Packets received again */
+    unsigned long late;       /**< Packets too old to be placed */
+    unsigned long expected;   /**< Packets sent, from the sequence numbers */
+    unsigned long lost;       /**< Sequence numbers skipped, less the ones
+                                   filled in the same window */
+    unsigned long bytes;      /**< Payload bytes received */
+    unsigned long bursts;     /**< Runs of consecutive lost packets */
+    unsigned long burst_max;  /**< The longest run of lost packets */
+    unsigned long gaps;       /**< Inter-arrival times measured */
+    double        gap_sum;    /**< Sum of inter-arrival times in seconds */
+    double        gap_sq;     /**< Sum of their squares */
+    double        gap_min;    /**< The shortest inter-arrival time */
+    double        gap_max;    /**< The longest inter-arrival time */
+} stats_counters;
+
+/** \typedef link_stats
+ * Statistics of a link over a tumbling window, reported and
+ * reset every tumbling seconds, and a sliding window of the
+ * last sliding seconds, kept as one bucket a second. Each
+ * packet updates a constant number of counters. The buckets
+ * are allocated apart, as many as the sliding window has
+ * seconds, so that the statistics of a link stay small.
+ */
+typedef struct {
+    int             tumbling;   /**< Seconds per tumbling window */
+    int             sliding;    /**< Seconds per sliding window */
+    struct timespec origin;     /**< When the statistics started */
+    long            second;     /**< Seconds from origin to now */
+    long            window;     /**< Second the tumbling window began */
+    int             started;    /**< Whether a packet was received */
+    struct timespec arrival;    /**< When the last packet arrived */
+    stats_counters  current;    /**< The tumbling window */
+    stats_counters *buckets;    /**< The sliding window, a bucket a second */
+} link_stats;
+
+void stats_counters_clear(stats_counters *);
+void stats_counters_add(stats_counters *, const stats_counters *);
+int link_stats_init(link_stats *, int, int, const struct timespec *);
+void link_stats_free(link_stats *);
+int link_stats_advance(link_stats *, const struct timespec *);
+int link_stats_rotate(link_stats *, stats_counters *);
+void link_stats_packet(link_stats *, const struct timespec *, int, uint32_t, int);
+void link_stats_sliding(const link_stats *, stats_counters *);
+int link_stats_timeout(const struct timespec *, const struct timespec *);
+void print_stats_counters(const char *, const stats_counters *, double);
+
+#endif
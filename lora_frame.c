@@ -0,0 +1,255 @@
+/** \file lora_frame.c
+ *
+ * Function definitions for framing LoRa packets on the
+ * serial link. A frame is laid out as follows:
+ *
+ * ---------------------------------------------------------
+ * | 0xa5 | 0x5a | length | payload | CRC-16 (2, big endian) |
+ * ---------------------------------------------------------
+ *
+ * The CRC-16 is CRC-16/CCITT-FALSE, i.e., polynomial 0x1021
+ * with initial value 0xffff, over length and payload.
+ */
+
+#include <string.h>    // For memcpy(), memmove(), memset().
+#include "header.h"
+#include "lora_frame.h"
+
+// CRC-16 of every byte value, filled on first use.
+static uint16_t crc_table[256];
+static int      crc_ready = FALSE;
+
+/** \fn static void crc16_init(void)
+ *
+ * Fill the table of CRC-16 values.
+ */
+static void crc16_init(void) {
+    uint16_t crc;
+
+    for (int i = 0; i < 256; i++) {
+        crc = i << 8;
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        crc_table[i] = crc;
+    }
+    crc_ready = TRUE;
+}
+
+/** \fn uint16_t crc16(const unsigned char *p, int len, uint16_t crc)
+ *
+ * Compute the CRC-16/CCITT-FALSE of a buffer, a byte at a
+ * time through a table.
+ * \param p The buffer.
+ * \param len The number of bytes.
+ * \param crc The CRC of preceding bytes, 0xffff to start.
+ * \return Returns the CRC.
+ */
+uint16_t crc16(const unsigned char *p, int len, uint16_t crc) {
+    if (!crc_ready)
+        crc16_init();
+    for (int i = 0; i < len; i++)
+        crc = (crc << 8) ^ crc_table[((crc >> 8) ^ p[i]) & 0xff];
+    return crc;
+}
+
+/** \fn int frame_encode(unsigned char *frame, const unsigned char *payload, int len)
+ *
+ * Build a frame around a payload.
+ * \param frame Where to build the frame, which needs
+ *        FRAME_MAX_SIZE bytes.
+ * \param payload The payload.
+ * \param len The payload length, at most FRAME_MAX_PAYLOAD.
+ * \return Returns -1 if the payload is too long, or the
+ *         frame length.
+ */
+int frame_encode(unsigned char *frame, const unsigned char *payload, int len) {
+    uint16_t crc;
+
+    if (len < 0 || len > FRAME_MAX_PAYLOAD)
+        return ERROR;
+    frame[0] = FRAME_SYNC1;
+    frame[1] = FRAME_SYNC2;
+    frame[2] = len;
+    memcpy(frame + FRAME_HEADER_SIZE, payload, len);
+    crc = crc16(frame + 2, len + 1, 0xffff);
+    frame[FRAME_HEADER_SIZE + len] = crc >> 8;
+    frame[FRAME_HEADER_SIZE + len + 1] = crc & 0xff;
+    return len + FRAME_OVERHEAD;
+}
+
+/** \fn int send_frame(int fd, const unsigned char *payload, int len)
+ *
+ * Frame a payload and send it through the LoRa module with
+ * a single write.
+ * \param fd The file descriptor of the LoRa serial port.
+ * \param payload The payload.
+ * \param len The payload length, at most FRAME_MAX_PAYLOAD.
+ * \return Returns -1 on error, or the frame length.
+ */
+int send_frame(int fd, const unsigned char *payload, int len) {
+    unsigned char frame[FRAME_MAX_SIZE];
+    int n;
+
+    if ((n = frame_encode(frame, payload, len)) < 0)
+        return ERROR;
+    if (write_all(fd, frame, n) < 0)
+        return ERROR;
+    return n;
+}
+
+/** \fn void frame_parser_init(frame_parser *fp)
+ *
+ * Initialize a frame parser.
+ */
+void frame_parser_init(frame_parser *fp) {
+    memset(fp, 0, sizeof(*fp));
+    fp->state = FRAME_HUNT;
+}
+
+/** \fn static void frame_resync(frame_parser *fp)
+ *
+ * Drop the first byte of a bad frame, and feed the rest
+ * of it, followed by any bytes still to be fed again,
+ * through the parser again.
+ */
+static void frame_resync(frame_parser *fp) {
+    int rest = fp->replay_len - fp->replay_pos;
+
+    // Bytes of this frame and bytes still to be fed again
+    // never add up to more than a frame.
+    memmove(fp->replay + fp->cnt - 1, fp->replay + fp->replay_pos, rest);
+    memcpy(fp->replay, fp->buf + 1, fp->cnt - 1);
+    fp->replay_len = fp->cnt - 1 + rest;
+    fp->replay_pos = 0;
+    fp->resyncs++;
+    fp->state = FRAME_HUNT;
+    fp->cnt = 0;
+}
+
+/** \fn static int frame_parse_byte(frame_parser *fp, unsigned char b)
+ *
+ * Feed a byte to the parser.
+ * \return Returns the payload length when the byte completes
+ *         a valid frame, -1 otherwise.
+ */
+static int frame_parse_byte(frame_parser *fp, unsigned char b) {
+    uint16_t crc;
+    int n;
+
+    switch (fp->state) {
+        case FRAME_HUNT:
+            if (b != FRAME_SYNC1) {
+                fp->skipped++;
+                break;
+            }
+            fp->buf[0] = b;
+            fp->cnt = 1;
+            fp->state = FRAME_SYNC;
+            break;
+        case FRAME_SYNC:
+            if (b == FRAME_SYNC2) {
+                fp->buf[fp->cnt++] = b;
+                fp->state = FRAME_LENGTH;
+            } else if (b != FRAME_SYNC1) {
+                fp->skipped += 2;
+                fp->state = FRAME_HUNT;
+            } else
+                fp->skipped++;
+            break;
+        case FRAME_LENGTH:
+            fp->buf[fp->cnt++] = b;
+            if (b > FRAME_MAX_PAYLOAD) {
+                fp->length_errors++;
+                frame_resync(fp);
+                break;
+            }
+            fp->len = b;
+            fp->state = FRAME_BODY;
+            break;
+        case FRAME_BODY:
+            fp->buf[fp->cnt++] = b;
+            if (fp->cnt < fp->len + FRAME_OVERHEAD)
+                break;
+            n = FRAME_HEADER_SIZE + fp->len;
+            crc = crc16(fp->buf + 2, fp->len + 1, 0xffff);
+            if (crc != (fp->buf[n] << 8 | fp->buf[n + 1])) {
+                fp->crc_errors++;
+                frame_resync(fp);
+                break;
+            }
+            fp->frames++;
+            fp->state = FRAME_HUNT;
+            fp->cnt = 0;
+            return fp->len;
+    }
+    return ERROR;
+}
+
+/** \fn int frame_parser_next(frame_parser *fp, ring_reader *r, const unsigned char **payload)
+ *
+ * Take the next valid frame out of the bytes buffered in a
+ * ring reader, without reading the port.
+ * \param fp The frame parser of the port.
+ * \param r The ring reader of the port.
+ * \param payload Where to store the address of the payload,
+ *        which is valid until the next call on this parser.
+ * \return Returns -1 if more input is needed, or the payload
+ *         length.
+ */
+int frame_parser_next(frame_parser *fp, ring_reader *r,
+    const unsigned char **payload) {
+    const unsigned char *p;
+    int avail, len, i;
+
+    *payload = fp->buf + FRAME_HEADER_SIZE;
+    while (1) {
+        // Bytes of a bad frame go before the rest of the ring.
+        while (fp->replay_pos < fp->replay_len)
+            if ((len = frame_parse_byte(fp, fp->replay[fp->replay_pos++])) >= 0)
+                return len;
+        if ((avail = ring_available(r)) <= 0)
+            return ERROR;
+        if (avail > RING_MAX_LINE)
+            avail = RING_MAX_LINE;
+        p = (unsigned char *)ring_peek(r, avail);
+        for (i = 0; i < avail; ) {
+            len = frame_parse_byte(fp, p[i++]);
+            if (len >= 0) {
+                ring_next_frame(r, i);
+                return len;
+            }
+            if (fp->replay_pos < fp->replay_len)
+                break;
+        }
+        ring_next_frame(r, i);
+    }
+}
+
+/** \fn int read_frame(frame_parser *fp, ring_reader *r, const unsigned char **payload)
+ *
+ * Read the next valid frame, filling the ring as needed.
+ * \param fp The frame parser of the port.
+ * \param r The ring reader of the port.
+ * \param payload Where to store the address of the payload.
+ * \return Returns -1 on error or end of file, or the payload
+ *         length.
+ */
+int read_frame(frame_parser *fp, ring_reader *r, const unsigned char **payload) {
+    int len;
+
+    while ((len = frame_parser_next(fp, r, payload)) < 0)
+        if (ring_fill(r) <= 0)
+            return ERROR;
+    return len;
+}
+
+/** \fn void print_frame_stats(const frame_parser *fp)
+ *
+ * Print the counters of a frame parser.
+ */
+void print_frame_stats(const frame_parser *fp) {
+    print_msg("frames: %lu valid, %lu CRC errors, %lu length errors, "
+              "%lu resyncs, %lu bytes skipped.",
+        fp->frames, fp->crc_errors, fp->length_errors,
+        fp->resyncs, fp->skipped);
+}
@@ -0,0 +1,61 @@
+/** \file lora_frame.h
+ *
+ * Macro definitions and function declarations for framing
+ * LoRa packets on the serial link.
+ */
+
+#ifndef _LORA_FRAME_H
+#define _LORA_FRAME_H
+
+#include <stdint.h>          // For fixed width integers.
+#include "io_ops.h"          // Ring reader.
+
+#define FRAME_SYNC1       0xa5  //< The first byte of the sync word.
+#define FRAME_SYNC2       0x5a  //< The second byte of the sync word.
+#define FRAME_HEADER_SIZE 3     //< Sync word and length.
+#define FRAME_CRC_SIZE    2     //< CRC-16 after the payload.
+#define FRAME_OVERHEAD    (FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+#define FRAME_MAX_SIZE    58    /*< The largest frame, which is the
+                                 * sub-packet size of AS32-TTL-100 in
+                                 * transparent mode, so that a frame
+                                 * is sent in a single air packet.
+                                 */
+#define FRAME_MAX_PAYLOAD (FRAME_MAX_SIZE - FRAME_OVERHEAD)
+
+// States of the frame parser.
+#define FRAME_HUNT        0     //< Looking for the first sync byte.
+#define FRAME_SYNC        1     //< Expecting the second sync byte.
+#define FRAME_LENGTH      2     //< Expecting the length byte.
+#define FRAME_BODY        3     //< Collecting payload and CRC.
+
+/** \typedef frame_parser
+ * A byte stream state machine that extracts frames from
+ * the LoRa serial link. When a frame fails its length or
+ * CRC check, the bytes after its first sync byte are fed
+ * through the parser again, so that a frame starting
+ * inside a corrupted one is not lost.
+ */
+typedef struct {
+    int           state;          /**< One of FRAME_HUNT, ... */
+    int           len;            /**< Payload length of this frame */
+    int           cnt;            /**< Bytes of this frame in buf */
+    unsigned char buf[FRAME_MAX_SIZE];    /**< This frame */
+    int           replay_len;     /**< Bytes to be fed again */
+    int           replay_pos;     /**< Next byte to be fed again */
+    unsigned char replay[FRAME_MAX_SIZE]; /**< Bytes to be fed again */
+    unsigned long frames;         /**< Valid frames */
+    unsigned long crc_errors;     /**< Frames failing the CRC */
+    unsigned long length_errors;  /**< Frames with a bad length */
+    unsigned long resyncs;        /**< Times the sync was lost */
+    unsigned long skipped;        /**< Bytes skipped outside frames */
+} frame_parser;
+
+uint16_t crc16(const unsigned char *, int, uint16_t);
+int frame_encode(unsigned char *, const unsigned char *, int);
+int send_frame(int, const unsigned char *, int);
+void frame_parser_init(frame_parser *);
+int frame_parser_next(frame_parser *, ring_reader *, const unsigned char **);
+int read_frame(frame_parser *, ring_reader *, const unsigned char **);
+void print_frame_stats(const frame_parser *);
+
+#endif
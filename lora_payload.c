@@ -0,0 +1,356 @@
+/** \file lora_payload.c
+ *
+ * Function definitions for encoding and decoding the
+ * binary payload of LoRa packets.
+ *
+ * A position report is laid out as follows, fixed width
+ * values are little endian:
+ *
+ * ---------------------------------------------------------------
+ * | version (4 bits), type (4 bits) | ADDH | ADDL | flags | ...
+ * ---------------------------------------------------------------
+ *
+ * ...----------------------
+ *     | sequence (varint) |
+ * ...----------------------
+ *
+ * ...------------------------------------------------------------------
+ *     |latitude (4) | longitude (4) | altitude (zig-zag) | [time] |
+ * ...------------------------------------------------------------------
+ *
+ * ADDH and ADDL are the address of the sender, which tells
+ * the streams of several senders apart. Latitude and
+ * longitude are unsigned in 1e-7 degrees, with their
+ * hemispheres in the flags, and altitude is in decimeters.
+ * The time is the GPS time of day at which the packet was
+ * sent, a varint in milliseconds, present when flagged.
+ * A report takes 14 to 26 bytes, instead of about 45 bytes
+ * of the comma separated ASCII packet.
+ *
+ * Between keyframes, i.e., absolute position reports, a
+ * sender sends deltas from the last keyframe:
+ *
+ * --------------------------------------------------------------------------
+ * | version, type | ADDH | ADDL | keyframe seq. | sequence - keyframe seq. |
+ * --------------------------------------------------------------------------
+ *
+ * ...----------------------------------------------------------
+ *     | latitude | longitude | altitude differences | [time] |
+ * ...----------------------------------------------------------
+ *
+ * Every field after the address is a (zig-zag) varint.
+ * The time, present when the keyframe has one, is the
+ * milliseconds since the time of the keyframe. A delta of
+ * a fix a few meters off the keyframe takes about 13
+ * bytes. Deltas refer to the keyframe rather than the
+ * previous packet, so a lost delta does not affect the
+ * following ones. Deltas carry the whole sequence number
+ * of their keyframe, so those whose keyframe was lost are
+ * never taken for deltas of an older one, however many
+ * packets were lost, and are dropped until the next
+ * keyframe.
+ */
+
+#include <math.h>      // For llround().
+#include <string.h>    // For memset().
+#include "header.h"
+#include "lora_payload.h"
+
+/** \fn int encode_varint(unsigned char *buf, uint32_t v)
+ *
+ * Encode an unsigned integer in 7-bit groups, least
+ * significant first, with the high bit set on all but
+ * the last byte.
+ * \param buf Where to encode, which needs up to 5 bytes.
+ * \param v The integer.
+ * \return Returns the number of bytes written.
+ */
+int encode_varint(unsigned char *buf, uint32_t v) {
+    int n = 0;
+
+    while (v >= 0x80) {
+        buf[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = v;
+    return n;
+}
+
+/** \fn int decode_varint(const unsigned char *buf, int len, uint32_t *v)
+ *
+ * Decode an integer written by encode_varint().
+ * \param buf The encoded bytes.
+ * \param len The number of bytes available.
+ * \param v Where to store the integer.
+ * \return Returns -1 if the varint is truncated or too
+ *         long, or the number of bytes read.
+ */
+int decode_varint(const unsigned char *buf, int len, uint32_t *v) {
+    uint32_t x = 0;
+
+    for (int i = 0; i < len && i < 5; i++) {
+        x |= (uint32_t)(buf[i] & 0x7f) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *v = x;
+            return i + 1;
+        }
+    }
+    return ERROR;
+}
+
+/** \fn int payload_source(const unsigned char *buf, int len)
+ *
+ * Get the sender address of a payload, before decoding it
+ * with the decoder of that sender.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \return Returns -1 on unknown versions, or the address.
+ */
+int payload_source(const unsigned char *buf, int len) {
+    if (len < PAYLOAD_HEADER || (buf[0] >> 4) != PAYLOAD_VERSION)
+        return ERROR;
+    return buf[1] << 8 | buf[2];
+}
+
+/** \fn static void put_u4(unsigned char *p, uint32_t v)
+ *
+ * Write a little endian unsigned 32-bit integer.
+ */
+static void put_u4(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+/** \fn static uint32_t get_u4(const unsigned char *p)
+ *
+ * Read a little endian unsigned 32-bit integer.
+ */
+static uint32_t get_u4(const unsigned char *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+        (uint32_t)p[3] << 24;
+}
+
+/** \fn position_report *gps_to_report(const gps_info *pg, uint32_t seq, position_report *pr)
+ *
+ * Convert GPS information to a position report.
+ * \param pg The GPS information of this sender.
+ * \param seq The sequence number of the report.
+ * \param pr Where to store the report, whose address is
+ *        left as it is, and whose time is left to be set
+ *        at transmit time.
+ * \return Always returns the report.
+ */
+position_report *gps_to_report(const gps_info *pg, uint32_t seq,
+    position_report *pr) {
+    pr->seq = seq;
+    pr->latitude = llround(nmea_to_degree(pg->latitude,
+        pg->ns_hemisphere) * 1e7);
+    pr->longitude = llround(nmea_to_degree(pg->longitude,
+        pg->ew_hemisphere) * 1e7);
+    pr->altitude = llround(pg->altitude * 10);
+    pr->fix_quality = pg->fix_quality;
+    pr->time = -1;
+    return pr;
+}
+
+/** \fn int encode_position(unsigned char *buf, const position_report *pr)
+ *
+ * Encode a position report.
+ * \param buf Where to encode, which needs PAYLOAD_MAX_SIZE
+ *        bytes.
+ * \param pr The report.
+ * \return Returns the payload length.
+ */
+int encode_position(unsigned char *buf, const position_report *pr) {
+    int n = 0, flags = 0;
+
+    if (pr->latitude < 0)
+        flags |= PAYLOAD_SOUTH;
+    if (pr->longitude < 0)
+        flags |= PAYLOAD_WEST;
+    flags |= (pr->fix_quality & PAYLOAD_FIX_MASK) << PAYLOAD_FIX_SHIFT;
+    if (pr->time >= 0)
+        flags |= PAYLOAD_TIME;
+
+    buf[n++] = PAYLOAD_VERSION << 4 | PAYLOAD_POSITION;
+    buf[n++] = pr->addr >> 8;
+    buf[n++] = pr->addr & 0xff;
+    buf[n++] = flags;
+    n += encode_varint(buf + n, pr->seq);
+    put_u4(buf + n, pr->latitude < 0 ? -(uint32_t)pr->latitude :
+        (uint32_t)pr->latitude);
+    n += 4;
+    put_u4(buf + n, pr->longitude < 0 ? -(uint32_t)pr->longitude :
+        (uint32_t)pr->longitude);
+    n += 4;
+    n += encode_varint(buf + n, ZIGZAG(pr->altitude));
+    if (pr->time >= 0)
+        n += encode_varint(buf + n, pr->time);
+    return n;
+}
+
+/** \fn int decode_position(const unsigned char *buf, int len, position_report *pr)
+ *
+ * Decode a position report.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \param pr Where to store the report.
+ * \return Returns -1 on malformed payloads or unknown
+ *         versions, 0 on success.
+ */
+int decode_position(const unsigned char *buf, int len, position_report *pr) {
+    uint32_t v;
+    int n = PAYLOAD_HEADER + 1, k, flags;
+
+    if (len < n || buf[0] != (PAYLOAD_VERSION << 4 | PAYLOAD_POSITION))
+        return ERROR;
+    pr->addr = buf[1] << 8 | buf[2];
+    flags = buf[3];
+
+    if ((k = decode_varint(buf + n, len - n, &pr->seq)) < 0)
+        return ERROR;
+    n += k;
+    if (len - n < 8)
+        return ERROR;
+    pr->latitude = get_u4(buf + n);
+    if (flags & PAYLOAD_SOUTH)
+        pr->latitude = -pr->latitude;
+    n += 4;
+    pr->longitude = get_u4(buf + n);
+    if (flags & PAYLOAD_WEST)
+        pr->longitude = -pr->longitude;
+    n += 4;
+    if ((k = decode_varint(buf + n, len - n, &v)) < 0)
+        return ERROR;
+    n += k;
+    pr->altitude = UNZIGZAG(v);
+    pr->fix_quality = (flags >> PAYLOAD_FIX_SHIFT) & PAYLOAD_FIX_MASK;
+    pr->time = -1;
+    if (flags & PAYLOAD_TIME) {
+        if (decode_varint(buf + n, len - n, &v) < 0 || v >= MS_PER_DAY)
+            return ERROR;
+        pr->time = v;
+    }
+    return OK;
+}
+
+/** \fn void position_encoder_init(position_encoder *pe, int interval)
+ *
+ * Initialize the encoder of a stream of reports.
+ * \param pe The encoder.
+ * \param interval Packets per keyframe, 1 for keyframes only.
+ */
+void position_encoder_init(position_encoder *pe, int interval) {
+    pe->interval = interval > 0 ? interval : 1;
+    pe->count = 0;
+    memset(&pe->key, 0, sizeof(pe->key));
+}
+
+/** \fn int encode_report(position_encoder *pe, unsigned char *buf, const position_report *pr)
+ *
+ * Encode the next report of a stream, as a keyframe or as
+ * a delta from the last keyframe.
+ * \param pe The encoder.
+ * \param buf Where to encode, which needs PAYLOAD_MAX_SIZE
+ *        bytes.
+ * \param pr The report.
+ * \return Returns the payload length.
+ */
+int encode_report(position_encoder *pe, unsigned char *buf,
+    const position_report *pr) {
+    int n = 0;
+
+    // A keyframe is also sent when the fix quality, which
+    // deltas do not carry, or whether there is a time,
+    // changes, and at the latest KEYFRAME_MAX_AGE packets
+    // after the last one, so that the sequence differences
+    // of deltas take at most two bytes.
+    if (pe->count == 0 || pr->fix_quality != pe->key.fix_quality ||
+        pr->addr != pe->key.addr || (pr->time < 0) != (pe->key.time < 0) ||
+        pr->seq - pe->key.seq >= KEYFRAME_MAX_AGE) {
+        pe->key = *pr;
+        pe->count = 1 % pe->interval;
+        return encode_position(buf, pr);
+    }
+    pe->count = (pe->count + 1) % pe->interval;
+
+    buf[n++] = PAYLOAD_VERSION << 4 | PAYLOAD_DELTA;
+    buf[n++] = pr->addr >> 8;
+    buf[n++] = pr->addr & 0xff;
+    n += encode_varint(buf + n, pe->key.seq);
+    n += encode_varint(buf + n, pr->seq - pe->key.seq);
+    // Differences are taken modulo 2^32, e.g., across the
+    // antimeridian, where they overflow int32_t.
+    n += encode_varint(buf + n, ZIGZAG(DIFF32(pr->latitude, pe->key.latitude)));
+    n += encode_varint(buf + n, ZIGZAG(DIFF32(pr->longitude, pe->key.longitude)));
+    n += encode_varint(buf + n, ZIGZAG(DIFF32(pr->altitude, pe->key.altitude)));
+    if (pr->time >= 0)
+        n += encode_varint(buf + n,
+            (pr->time - pe->key.time + MS_PER_DAY) % MS_PER_DAY);
+    return n;
+}
+
+/** \fn void position_decoder_init(position_decoder *pd)
+ *
+ * Initialize the decoder of the stream of one sender.
+ */
+void position_decoder_init(position_decoder *pd) {
+    memset(pd, 0, sizeof(*pd));
+}
+
+/** \fn int decode_report(position_decoder *pd, const unsigned char *buf, int len, position_report *pr)
+ *
+ * Decode the next payload of a stream into an absolute
+ * report.
+ * \param pd The decoder of the sender.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \param pr Where to store the report.
+ * \return Returns -1 on malformed payloads, or deltas whose
+ *         keyframe was lost, 0 on success.
+ */
+int decode_report(position_decoder *pd, const unsigned char *buf, int len,
+    position_report *pr) {
+    uint32_t v[6];
+    int n = PAYLOAD_HEADER, k;
+
+    if (len < n + 1 || (buf[0] >> 4) != PAYLOAD_VERSION)
+        return ERROR;
+
+    switch (buf[0] & 0x0f) {
+        case PAYLOAD_POSITION:
+            if (decode_position(buf, len, pr) < 0)
+                return ERROR;
+            pd->key = *pr;
+            pd->valid = TRUE;
+            pd->keyframes++;
+            return OK;
+        case PAYLOAD_DELTA:
+            for (int i = 0; i < 5; i++, n += k)
+                if ((k = decode_varint(buf + n, len - n, &v[i])) < 0)
+                    return ERROR;
+            if (!pd->valid || v[0] != pd->key.seq ||
+                (buf[1] << 8 | buf[2]) != pd->key.addr) {
+                pd->orphans++;
+                return ERROR;
+            }
+            pr->addr = pd->key.addr;
+            pr->seq = pd->key.seq + v[1];
+            pr->latitude = SUM32(pd->key.latitude, UNZIGZAG(v[2]));
+            pr->longitude = SUM32(pd->key.longitude, UNZIGZAG(v[3]));
+            pr->altitude = SUM32(pd->key.altitude, UNZIGZAG(v[4]));
+            pr->fix_quality = pd->key.fix_quality;
+            pr->time = -1;
+            if (pd->key.time >= 0) {
+                if (decode_varint(buf + n, len - n, &v[5]) < 0)
+                    return ERROR;
+                pr->time = (pd->key.time + v[5]) % MS_PER_DAY;
+            }
+            pd->deltas++;
+            return OK;
+        default:
+            return ERROR;
+    }
+}
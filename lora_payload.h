@@ -0,0 +1,91 @@
+/** \file lora_payload.h
+ *
+ * Type definitions and function declarations for the
+ * binary payload of LoRa packets.
+ */
+
+#ifndef _LORA_PAYLOAD_H
+#define _LORA_PAYLOAD_H
+
+#include <stdint.h>          // For fixed width integers.
+#include "gps_analyzer.h"    // gps_info.
+
+#define PAYLOAD_VERSION   4     //< Version of the payload format.
+#define PAYLOAD_MAX_SIZE  32    //< The longest payload encoded.
+
+// Payload types, in the low 4 bits of the first byte.
+#define PAYLOAD_POSITION  1     //< An absolute position report, i.e., a keyframe.
+#define PAYLOAD_DELTA     2     //< A report relative to the last keyframe.
+#define PAYLOAD_HEADER    3     //< Version, type and sender address.
+
+#define KEYFRAME_INTERVAL 10    //< Default packets per keyframe.
+#define KEYFRAME_MAX_AGE  255   //< The most packets from a keyframe on.
+
+// Flags of a position report.
+#define PAYLOAD_SOUTH     0x01  //< Latitude in south hemisphere.
+#define PAYLOAD_WEST      0x02  //< Longitude in west hemisphere.
+#define PAYLOAD_FIX_SHIFT 2     //< Fix quality in bits 2 to 4.
+#define PAYLOAD_FIX_MASK  0x07
+#define PAYLOAD_TIME      0x20  //< Transmit time follows altitude.
+
+#define MS_PER_DAY        86400000  //< Range of transmit times.
+
+// Zig-zag mapping of signed integers, so that small
+// negative values also encode to short varints.
+#define ZIGZAG(v)   (((uint32_t)(v) << 1) ^ (uint32_t)((int32_t)(v) >> 31))
+#define UNZIGZAG(v) ((int32_t)(((v) >> 1) ^ -(int32_t)((v) & 1)))
+
+// Difference and sum of signed integers modulo 2^32,
+// without the undefined behavior of int32_t overflow.
+#define DIFF32(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))
+#define SUM32(a, b)  ((int32_t)((uint32_t)(a) + (uint32_t)(b)))
+
+/** \typedef position_report
+ * A position report carried by a LoRa packet.
+ */
+typedef struct {
+    uint16_t addr;         /**< Sender address, ADDH and ADDL */
+    uint32_t seq;          /**< Sequence number */
+    int32_t  latitude;     /**< Latitude in 1e-7 degrees, south negative */
+    int32_t  longitude;    /**< Longitude in 1e-7 degrees, west negative */
+    int32_t  altitude;     /**< Altitude in decimeters */
+    int      fix_quality;  /**< GGA fix quality */
+    int32_t  time;         /**< Transmit time in milliseconds of the
+                                UTC day, -1 if unknown */
+} position_report;
+
+/** \typedef position_encoder
+ * State of a sender encoding a stream of reports as a
+ * keyframe every interval packets, and deltas from that
+ * keyframe in between.
+ */
+typedef struct {
+    int             interval;  /**< Packets per keyframe */
+    int             count;     /**< Packets since the last keyframe */
+    position_report key;       /**< The last keyframe */
+} position_encoder;
+
+/** \typedef position_decoder
+ * State of a receiver rebuilding absolute reports from
+ * the stream of one sender.
+ */
+typedef struct {
+    int             valid;     /**< Whether key holds a keyframe */
+    position_report key;       /**< The last keyframe */
+    unsigned long   keyframes; /**< Keyframes decoded */
+    unsigned long   deltas;    /**< Deltas decoded */
+    unsigned long   orphans;   /**< Deltas whose keyframe was lost */
+} position_decoder;
+
+int encode_varint(unsigned char *, uint32_t);
+int decode_varint(const unsigned char *, int, uint32_t *);
+int payload_source(const unsigned char *, int);
+position_report *gps_to_report(const gps_info *, uint32_t, position_report *);
+int encode_position(unsigned char *, const position_report *);
+int decode_position(const unsigned char *, int, position_report *);
+void position_encoder_init(position_encoder *, int);
+int encode_report(position_encoder *, unsigned char *, const position_report *);
+void position_decoder_init(position_decoder *);
+int decode_report(position_decoder *, const unsigned char *, int, position_report *);
+
+#endif
@@ -0,0 +1,543 @@
+/** \file nmea_bench.c
+ *
+ * Benchmark of the NMEA read path, without any module
+ * attached, on a recorded corpus, e.g.,
+ * cat /dev/ttyUSB1 > gps.log, or on a synthetic one of GGA,
+ * RMC, GSA and VTG sentences in turn.
+ *
+ * Each pass over the corpus is timed, and the best of
+ * several passes is reported, so that a pass slowed by
+ * the scheduler does not count.
+ *
+ * - tokenize: the fields of the GGA sentences found, and
+ *   decoded by get_gps_info(), with a single
+ *   nmea_tokenize() per sentence, against the former way
+ *   of rescanning the sentence with get_nth_parameter()
+ *   for every field.
+ * - checksum: nmea_xor(), eight bytes at a time, against
+ *   a byte at a time, and the cost of nmea_verify() in
+ *   front of decode_nmea(). Every sentence is also
+ *   verified with a byte of it changed, which should fail.
+ * - syscalls: the read() calls per sentence of the ring
+ *   reader against the former way of a read() per byte,
+ *   through a pipe. The corpus is written a fix of
+ *   BENCH_EPOCH sentences at a time, either all at once,
+ *   as a backlog on a fast port, or each fix once the one
+ *   before is read, as a GPS module at its update rate.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include "nmea_bench.h"
+
+/** \fn static double elapsed(const struct timespec *start)
+ *
+ * Get the seconds since a time on CLOCK_MONOTONIC.
+ */
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+        (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/** \fn static int bench_sentence(char *buf, int i)
+ *
+ * Write the ith sentence of the synthetic corpus, with its
+ * checksum and line end. A fix takes four sentences, and
+ * the position moves a little from fix to fix.
+ * \param buf Where to write, GPS_INFO_SIZE bytes at least.
+ * \param i The index of the sentence.
+ * \return Returns the length written.
+ */
+static int bench_sentence(char *buf, int i) {
+    int fix = i / 4, hh = fix / 3600 % 24, mm = fix / 60 % 60, ss = fix % 60;
+    double lat = 3110.4567 + fix % 1000 * 0.00113;
+    double lon = 12128.3012 + fix % 997 * 0.00127;
+    unsigned char x = 0;
+    int len;
+
+    switch (i % 4) {
+        case 0:
+            len = sprintf(buf, "$GPGGA,%02d%02d%02d.00,%.5f,N,%.5f,E,1,%02d,"
+                "0.9,%.1f,M,8.9,M,,", hh, mm, ss, lat, lon,
+                6 + fix % 7, 12.5 + fix % 50 * 0.1);
+            break;
+        case 1:
+            len = sprintf(buf, "$GPRMC,%02d%02d%02d.00,A,%.5f,N,%.5f,E,"
+                "%.3f,%.2f,161026,,,A", hh, mm, ss, lat, lon,
+                fix % 30 * 0.137, fix % 360 * 1.0);
+            break;
+        case 2:
+            len = sprintf(buf, "$GPGSA,A,3,04,05,,09,12,,,24,,,,,"
+                "2.5,1.3,2.1");
+            break;
+        default:
+            len = sprintf(buf, "$GPVTG,%.2f,T,,M,%.3f,N,%.3f,K,A",
+                fix % 360 * 1.0, fix % 30 * 0.137, fix % 30 * 0.254);
+    }
+    // The checksum is computed a byte at a time here, apart
+    // from nmea_xor().
+    for (int k = 1; k < len; k++)
+        x ^= (unsigned char)buf[k];
+    return len + sprintf(buf + len, "*%02X\r\n", x);
+}
+
+/** \fn static void bench_generate(int n)
+ *
+ * Make a synthetic corpus of n sentences.
+ */
+static void bench_generate(int n) {
+    if ((corpus.text = malloc((long)n * GPS_INFO_SIZE)) == NULL)
+        error_dump("fail to allocate the corpus.");
+    corpus.bytes = 0;
+    for (int i = 0; i < n; i++)
+        corpus.bytes += bench_sentence(corpus.text + corpus.bytes, i);
+}
+
+/** \fn static int bench_load(const char *path)
+ *
+ * Load a recorded corpus.
+ * \param path The NMEA log.
+ * \return Returns -1 on error, 0 on success.
+ */
+static int bench_load(const char *path) {
+    long size;
+    FILE *fp;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        return ERROR;
+    if (fseek(fp, 0, SEEK_END) < 0 || (size = ftell(fp)) <= 0 ||
+        fseek(fp, 0, SEEK_SET) < 0 ||
+        (corpus.text = malloc(size)) == NULL ||
+        fread(corpus.text, 1, size, fp) != (size_t)size) {
+        fclose(fp);
+        return ERROR;
+    }
+    corpus.bytes = size;
+    fclose(fp);
+    return OK;
+}
+
+/** \fn static void bench_index(void)
+ *
+ * Split the text of the corpus into lines, without their
+ * line ends, and count the GGA sentences.
+ */
+static void bench_index(void) {
+    int max = 0, start = 0;
+    long i;
+
+    corpus.copy = malloc(corpus.bytes + 1);
+    for (i = 0; i < corpus.bytes; i++)
+        max += corpus.text[i] == '\n';
+    corpus.lines = malloc((max + 1) * sizeof(char *));
+    corpus.lens = malloc((max + 1) * sizeof(int));
+    if (corpus.copy == NULL || corpus.lines == NULL || corpus.lens == NULL)
+        error_dump("fail to allocate the corpus.");
+    memcpy(corpus.copy, corpus.text, corpus.bytes);
+    corpus.copy[corpus.bytes] = '\n';
+
+    for (i = 0; i <= corpus.bytes; i++) {
+        if (corpus.copy[i] != '\n')
+            continue;
+        corpus.copy[i] = '\0';
+        if (i > start && corpus.copy[i - 1] == '\r')
+            corpus.copy[i - 1] = '\0';
+        corpus.lines[corpus.count] = corpus.copy + start;
+        corpus.lens[corpus.count] = strlen(corpus.copy + start);
+        if (corpus.lens[corpus.count] > 0) {
+            corpus.gga +=
+                nmea_sentence_type(corpus.lines[corpus.count]) == NMEA_GGA;
+            corpus.count++;
+        }
+        start = i + 1;
+    }
+}
+
+/** \fn static gps_info *rescan_gps_info(char *cmd, gps_info *pg)
+ *
+ * Decode a GGA sentence the former way, as the baseline:
+ * every field is found by get_nth_parameter(), which scans
+ * the sentence from its start, after the sentence type is
+ * checked again.
+ */
+static gps_info *rescan_gps_info(char *cmd, gps_info *pg) {
+    char param[GPS_INFO_SIZE];
+
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 1, param) == NULL)
+        return NULL;
+    pg->utc_time = strtod(param, NULL);
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 2, param) == NULL)
+        return NULL;
+    pg->latitude = strtod(param, NULL);
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 3, param) == NULL)
+        return NULL;
+    pg->ns_hemisphere = param[0];
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 4, param) == NULL)
+        return NULL;
+    pg->longitude = strtod(param, NULL);
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 5, param) == NULL)
+        return NULL;
+    pg->ew_hemisphere = param[0];
+    if (is_gpgga(cmd) != TRUE || get_nth_parameter(cmd, 9, param) == NULL)
+        return NULL;
+    pg->altitude = strtod(param, NULL);
+    return pg;
+}
+
+/** \fn static int rescan_fields(char *cmd)
+ *
+ * Find the fields of get_gps_info() the former way, one
+ * scan from the start of the sentence each.
+ * \return Returns the sum of the field lengths.
+ */
+static int rescan_fields(char *cmd) {
+    static const int wanted[] = { 1, 2, 3, 4, 5, 9 };
+    char param[GPS_INFO_SIZE];
+    int sum = 0;
+
+    for (int i = 0; i < 6; i++) {
+        if (is_gpgga(cmd) != TRUE ||
+            get_nth_parameter(cmd, wanted[i], param) == NULL)
+            return 0;
+        sum += strlen(param);
+    }
+    return sum;
+}
+
+/** \fn static int tokenized_fields(const char *cmd)
+ *
+ * Find the fields of get_gps_info() in the table of a
+ * single nmea_tokenize().
+ * \return Returns the sum of the field lengths.
+ */
+static int tokenized_fields(const char *cmd) {
+    static const int wanted[] = { 1, 2, 3, 4, 5, 9 };
+    nmea_fields f;
+    int sum = 0, len;
+
+    if (nmea_sentence_type(cmd) != NMEA_GGA || nmea_tokenize(cmd, &f) < 0)
+        return 0;
+    for (int i = 0; i < 6; i++) {
+        if (nmea_field(&f, wanted[i], &len) == NULL)
+            return 0;
+        sum += len;
+    }
+    return sum;
+}
+
+/** \fn static int bench_tokenize(void)
+ *
+ * Time the GGA sentences the former way and tokenized:
+ * finding the fields alone, and decoding them, where
+ * get_gps_info() converts all nine fields of GGA against
+ * the six of the former way. Check the two agree.
+ * \return Returns -1 if they do not, 0 otherwise.
+ */
+static int bench_tokenize(void) {
+    struct timespec start;
+    gps_info old, now;
+    double t, best[4] = { 1e9, 1e9, 1e9, 1e9 }, sum[2] = { 0, 0 };
+    long len[2] = { 0, 0 };
+    int differ = 0;
+
+    for (int i = 0; i < corpus.count; i++) {
+        memset(&old, 0, sizeof(old));
+        memset(&now, 0, sizeof(now));
+        if ((rescan_gps_info(corpus.lines[i], &old) == NULL) !=
+            (get_gps_info(corpus.lines[i], &now) == NULL) ||
+            old.utc_time != now.utc_time || old.latitude != now.latitude ||
+            old.longitude != now.longitude || old.altitude != now.altitude ||
+            rescan_fields(corpus.lines[i]) != tokenized_fields(corpus.lines[i]))
+            differ++;
+    }
+    // The sums keep the passes from being optimized out.
+    for (int k = 0; k < repeats; k++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            len[0] += rescan_fields(corpus.lines[i]);
+        if ((t = elapsed(&start)) < best[0])
+            best[0] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            len[1] += tokenized_fields(corpus.lines[i]);
+        if ((t = elapsed(&start)) < best[1])
+            best[1] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            if (rescan_gps_info(corpus.lines[i], &old) != NULL)
+                sum[0] += old.latitude;
+        if ((t = elapsed(&start)) < best[2])
+            best[2] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            if (get_gps_info(corpus.lines[i], &now) != NULL)
+                sum[1] += now.latitude;
+        if ((t = elapsed(&start)) < best[3])
+            best[3] = t;
+    }
+    print_msg("tokenize: %d GGA of %d sentences, %d differ%s.",
+        corpus.gga, corpus.count, differ,
+        len[0] != len[1] || sum[0] != sum[1] ? ", sums differ" : "");
+    print_msg("  fields: rescan %.1f ns, tokenized %.1f ns per GGA, %.2fx.",
+        best[0] * 1e9 / corpus.gga, best[1] * 1e9 / corpus.gga,
+        best[0] / best[1]);
+    print_msg("  decode: rescan %.1f ns, get_gps_info() %.1f ns per GGA, "
+              "%.2fx.", best[2] * 1e9 / corpus.gga,
+        best[3] * 1e9 / corpus.gga, best[2] / best[3]);
+    return differ == 0 && len[0] == len[1] && sum[0] == sum[1] ? OK : ERROR;
+}
+
+/** \fn static unsigned char byte_xor(const char *p, int len)
+ *
+ * Compute the XOR of a buffer a byte at a time, as the
+ * baseline of nmea_xor().
+ */
+static unsigned char byte_xor(const char *p, int len) {
+    unsigned char x = 0;
+
+    for (int i = 0; i < len; i++)
+        x ^= (unsigned char)p[i];
+    return x;
+}
+
+/** \fn static int bench_checksum(void)
+ *
+ * Time the checksum of every sentence, and the decoding of
+ * the corpus with and without nmea_verify(). Check that
+ * nmea_xor() agrees with byte_xor(), and that a sentence
+ * with a byte changed fails nmea_verify().
+ * \return Returns -1 if a check fails, 0 otherwise.
+ */
+static int bench_checksum(void) {
+    struct timespec start;
+    char buf[GPS_INFO_SIZE];
+    gps_info info;
+    double t, best[4] = { 1e9, 1e9, 1e9, 1e9 };
+    unsigned long sum[2] = { 0, 0 }, fixes[2] = { 0, 0 };
+    int differ = 0, passed = 0, valid = 0, len, at;
+
+    for (int i = 0; i < corpus.count; i++) {
+        len = corpus.lens[i];
+        if (nmea_xor(corpus.lines[i], len) != byte_xor(corpus.lines[i], len))
+            differ++;
+        if (len <= 4 || len >= GPS_INFO_SIZE ||
+            nmea_verify(corpus.lines[i], len) != TRUE)
+            continue;
+        valid++;
+        // A bit flipped between '$' and '*'.
+        memcpy(buf, corpus.lines[i], len + 1);
+        at = 1 + i % (len - 4);
+        buf[at] ^= 1 << i % 7;
+        passed += nmea_verify(buf, len) == TRUE;
+    }
+    for (int k = 0; k < repeats; k++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            sum[0] += byte_xor(corpus.lines[i], corpus.lens[i]);
+        if ((t = elapsed(&start)) < best[0])
+            best[0] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            sum[1] += nmea_xor(corpus.lines[i], corpus.lens[i]);
+        if ((t = elapsed(&start)) < best[1])
+            best[1] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            fixes[0] += decode_nmea(corpus.lines[i], &info) == NMEA_GGA;
+        if ((t = elapsed(&start)) < best[2])
+            best[2] = t;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < corpus.count; i++)
+            fixes[1] += nmea_verify(corpus.lines[i], corpus.lens[i]) == TRUE &&
+                decode_nmea(corpus.lines[i], &info) == NMEA_GGA;
+        if ((t = elapsed(&start)) < best[3])
+            best[3] = t;
+    }
+    print_msg("checksum: %d of %d sentences valid, %d differ, "
+              "%d passed with a bit flipped.",
+        valid, corpus.count, differ, passed);
+    print_msg("  xor: a byte at a time %.1f ns, nmea_xor() %.1f ns per "
+              "sentence, %.2fx, %.0f MB/s.",
+        best[0] * 1e9 / corpus.count, best[1] * 1e9 / corpus.count,
+        best[0] / best[1], corpus.bytes / best[1] / 1e6);
+    print_msg("  decode: %.1f ns, verified %.1f ns per sentence, %+.1f%%.",
+        best[2] * 1e9 / corpus.count, best[3] * 1e9 / corpus.count,
+        (best[3] / best[2] - 1) * 100);
+    return differ == 0 && passed == 0 && sum[0] == sum[1] &&
+        (valid < corpus.count || fixes[0] == fixes[1]) ? OK : ERROR;
+}
+
+/** \fn static void *bench_writer(void *arg)
+ *
+ * Write the corpus to a pipe a fix at a time, and close
+ * it. If paced, wait for each fix to be read before the
+ * next one.
+ * \param arg The bench_pipe.
+ * \return Always returns NULL.
+ */
+static void *bench_writer(void *arg) {
+    bench_pipe *bp = arg;
+    long from = 0, to = 0;
+    int lines = 0;
+
+    while (from < corpus.bytes) {
+        for (lines = 0; to < corpus.bytes && lines < BENCH_EPOCH; to++)
+            lines += corpus.text[to] == '\n';
+        if (write_all(bp->fd[1], corpus.text + from, to - from) < 0)
+            break;
+        from = to;
+        if (bp->paced && from < corpus.bytes)
+            sem_wait(&bp->drained);
+    }
+    close(bp->fd[1]);
+    return NULL;
+}
+
+/** \fn static int byte_read_line(int fd, char *buf, int size, unsigned long *calls)
+ *
+ * Read a line the former way, as the baseline of the ring
+ * reader: a read() per byte.
+ * \param calls Where to count the read() calls.
+ * \return Returns -1 on error or end of file, or the line
+ *         length.
+ */
+static int byte_read_line(int fd, char *buf, int size, unsigned long *calls) {
+    int i, n;
+
+    for (i = 0; i < size - 1; i++) {
+        do
+            n = read(fd, buf + i, 1);
+        while (n < 0 && errno == EINTR);
+        (*calls)++;
+        if (n <= 0)
+            return ERROR;
+        if (buf[i] == '\n')
+            break;
+    }
+    buf[i] = '\0';
+    return i;
+}
+
+/** \fn static double bench_read(int paced, int ring, unsigned long *calls, unsigned long *lines)
+ *
+ * Read the corpus from a pipe, line by line.
+ * \param paced Whether each fix is written once the one
+ *        before is read.
+ * \param ring Whether to read through the ring reader, or
+ *        a read() per byte.
+ * \param calls Where to store the read() calls.
+ * \param lines Where to store the lines read.
+ * \return Returns the seconds taken.
+ */
+static double bench_read(int paced, int ring, unsigned long *calls,
+    unsigned long *lines) {
+    bench_pipe bp;
+    pthread_t thread;
+    struct timespec start;
+    ring_reader *r = NULL;
+    char buf[BUF_SIZE];
+    double seconds;
+    int cnt;
+
+    bp.paced = paced;
+    if (pipe(bp.fd) < 0 || sem_init(&bp.drained, 0, 0) < 0)
+        error_dump("fail to create a pipe.");
+    if (ring && (r = ring_reader_init(get_ring_reader(bp.fd[0]),
+        bp.fd[0])) == NULL)
+        error_dump("fail");
+    *calls = *lines = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (pthread_create(&thread, NULL, bench_writer, &bp) != 0)
+        error_dump("fail to start the writer.");
+    while (1) {
+        if (ring)
+            cnt = ring_read_line(r, &cnt) != NULL ? cnt : ERROR;
+        else
+            cnt = byte_read_line(bp.fd[0], buf, sizeof(buf), calls);
+        if (cnt < 0)
+            break;
+        if (++*lines % BENCH_EPOCH == 0 && paced)
+            sem_post(&bp.drained);
+    }
+    pthread_join(thread, NULL);
+    seconds = elapsed(&start);
+    if (ring)
+        *calls = r->nread;
+    close(bp.fd[0]);
+    sem_destroy(&bp.drained);
+    return seconds;
+}
+
+/** \fn static int bench_syscalls(void)
+ *
+ * Count the read() calls per sentence of the ring reader
+ * and of a read() per byte, as a backlog and paced.
+ * \return Returns -1 if the lines read differ, 0 otherwise.
+ */
+static int bench_syscalls(void) {
+    static const char *modes[] = { "backlog", "paced" };
+    unsigned long calls[2], lines[2];
+    double seconds[2];
+    int failed = 0;
+
+    for (int paced = 0; paced < 2; paced++) {
+        for (int ring = 0; ring < 2; ring++)
+            seconds[ring] = bench_read(paced, ring, &calls[ring], &lines[ring]);
+        print_msg("syscalls, %s: a read() per byte %.2f, ring reader %.3f "
+                  "calls per line, %.1fx fewer; %.3f s against %.3f s.",
+            modes[paced], (double)calls[0] / lines[0],
+            (double)calls[1] / lines[1], (double)calls[0] / calls[1],
+            seconds[0], seconds[1]);
+        failed |= lines[0] != lines[1];
+    }
+    return failed ? ERROR : OK;
+}
+
+int main(int argc, char *argv[]) {
+    int opt, n = BENCH_SENTENCES, failed = 0;
+
+    // Usage: nmea_bench [-n sentences] [-r repeats] [nmea_log]
+    // -n: sentences of the synthetic corpus, BENCH_SENTENCES
+    //     by default.
+    // -r: passes over the corpus timed, BENCH_REPEATS by
+    //     default.
+    // Without nmea_log, the synthetic corpus is used.
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (n < 1 || repeats < 1 || argc - optind > 1)
+        error_dump("argument misconfiguration.");
+
+    if (optind < argc) {
+        if (bench_load(argv[optind]) < 0)
+            error_dump("fail to load %s.", argv[optind]);
+    } else {
+        bench_generate(n);
+    }
+    bench_index();
+    if (corpus.gga == 0)
+        error_dump("no GGA sentence in the corpus.");
+    print_msg("%s: %ld bytes, %d sentences.",
+        optind < argc ? argv[optind] : "synthetic", corpus.bytes,
+        corpus.count);
+
+    failed |= bench_tokenize() < 0;
+    failed |= bench_checksum() < 0;
+    failed |= bench_syscalls() < 0;
+    return failed ? ERROR : OK;
+}
@@ -0,0 +1,65 @@
+/** \file nmea_bench.h
+ *
+ * Function declarations for the benchmark of the NMEA
+ * read path on a recorded or synthetic corpus.
+ */
+
+#ifndef NMEA_BENCH_H
+#define NMEA_BENCH_H
+
+#include <time.h>                   // Timing of each pass
+#include <pthread.h>                // The writer of the pipe
+#include <semaphore.h>              // A fix read before the next
+#include "header.h"
+#include "io_ops.h"                 // Ring reader
+#include "gps_analyzer.h"           // NMEA parsing
+
+#define BENCH_SENTENCES 100000      //< Sentences of the synthetic corpus.
+#define BENCH_REPEATS   20          //< Passes over the corpus timed.
+#define BENCH_EPOCH     4           //< Sentences of a fix, written at once.
+
+/** \typedef nmea_corpus
+ * The sentences of the benchmark, as read from the port,
+ * and split into lines without their line ends.
+ */
+typedef struct {
+    char  *text;        /**< The sentences as read from the port */
+    long   bytes;       /**< Bytes of text */
+    char  *copy;        /**< The lines, each terminated by '\0' */
+    char **lines;       /**< Where each line begins */
+    int   *lens;        /**< The length of each line */
+    int    count;       /**< Number of lines */
+    int    gga;         /**< Number of GGA sentences */
+} nmea_corpus;
+
+/** \typedef bench_pipe
+ * The pipe the corpus is read from.
+ */
+typedef struct {
+    int   fd[2];        /**< Read and write ends */
+    int   paced;        /**< Whether a fix waits for the one before */
+    sem_t drained;      /**< Posted when a fix is read */
+} bench_pipe;
+
+// The corpus.
+static nmea_corpus corpus;
+// Passes over the corpus timed.
+static int         repeats = BENCH_REPEATS;
+
+static double elapsed(const struct timespec *);
+static int bench_sentence(char *, int);
+static void bench_generate(int);
+static int bench_load(const char *);
+static void bench_index(void);
+static gps_info *rescan_gps_info(char *, gps_info *);
+static int rescan_fields(char *);
+static int tokenized_fields(const char *);
+static int bench_tokenize(void);
+static unsigned char byte_xor(const char *, int);
+static int bench_checksum(void);
+static void *bench_writer(void *);
+static int byte_read_line(int, char *, int, unsigned long *);
+static double bench_read(int, int, unsigned long *, unsigned long *);
+static int bench_syscalls(void);
+
+#endif
@@ -3,164 +3,271 @@
  * Function definitions for the senders in
  * point-to-point communication test.
  *
- * Receiver operation sequence (ver. 0.0):
+ * Receiver operation sequence:
  *
  *                  ---------------------------
- *                  |       start timer       |
- *                  ---------------------------
- *                                |
- *                                V
- *                  ---------------------------
- *                  | block receive a packet  |
- *       ---------->| record lost packets and |
- *       |          | accept packets.         |
+ *                  | wait for LoRa input, at |
+ *       ---------->| most until the next     |
+ *       |          | second.                 |
  *       |          ---------------------------
  *       |                        |
  *       |                        V
- *       |                       / \
- *       |           N         / if  \
- *       |<------------------/ over 20 \
- *       |                   \ seconds /
- *       |                     \  ?  /
- *       |                       \ /
- *       |                        | Y
- *       |                        V
  *       |         -------------------------------
- *       |         | Reset timer, compute packet |
- *       |         | recept rate and distance,   |
- *       |         | reset all counters.         |
+ *       |         | Move the statistics windows,|
+ *       |         | report the tumbling window  |
+ *       |         | when it is over.            |
  *       |         -------------------------------
  *       |                        |
+ *       |                        V
+ *       |          ---------------------------
+ *       |          | accept packets against  |
+ *       |          | the latest GPS fix.     |
+ *       |          ---------------------------
+ *       |                        |
  *       --------------------------
  */
 
-#include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include "p2p_receiver.h"
 
-/** \rn static void sig_alrm(int signo)
+/** \fn static lora_port *open_lora_port(lora_port *lp, const char *name)
  *
- * Signal handler for signal SIGALRM.
+ * Open a LoRa module to receive from. The module is not
+ * configured here: it takes commands only in its
+ * configuration mode (M0 and M1 high), in which it does
+ * not receive, and in normal mode it would send them over
+ * the air. The channel is set beforehand with provision.
+ * \param lp Where to store the context of the module.
+ * \param name The serial port name.
+ * \return Returns the context.
  */
-static void sig_alrm(int signo) {
-    if (signo == SIGALRM) {
-        if (signal(SIGALRM, sig_alrm) == SIG_ERR)
-            exit(-1);
-        // If we have more received packets than the packets 
-        // sent by sender, we have received one packet belonging
-        // to last test run. So the PRR of this test run is 100%.
-        if (cnt > TIMER) {
-            print_msg("\033[47;31mPRR: 100.00%%\033[0m\n");
-        } else if (cnt == TIMER - 1) {
-            // If we lost only 1 packet and the received packets
-            // are all in order, the last sent packet will appear
-            // in the next test run. So we also have a PRR of
-            // 100% in this test run.
-            if (last - first == cnt)
-                printf("\033[47;31mPRR: 100.00%%\033[0m\n");
-            // Else, we lost 1 packet.
-            else
-                printf("\033[47;31mPRR: %.2lf%%\033[0m\n", (double)(cnt) / (double)(TIMER) * 100);
-        } else {
-            printf("\033[47;31mPRR: %.2lf%%\033[0m\n", (double)(cnt) / (double)(TIMER) * 100);
-        }
-        // Reset variables for next test run.
-        first = -1;
-        last = -1;
-        cnt = 0;
-        // Restart the alarm timer.
-        alarm(TIMER);
+static lora_port *open_lora_port(lora_port *lp, const char *name) {
+    memset(lp, 0, sizeof(*lp));
+    lp->name = name;
+    if ((lp->fd = raw_receive_init_nparity(lp->name)) < 0)
+        error_dump("fail");
+    if ((lp->reader = get_ring_reader(lp->fd)) == NULL)
+        error_dump("fail");
+    if (set_nonblock(lp->fd) < 0)
+        error_dump("fail to set non-blocking mode.");
+    frame_parser_init(&lp->parser);
+    return lp;
+}
+
+/** \fn static void report_stats(const struct timespec *now)
+ *
+ * Report the statistics windows of the senders that are
+ * over, followed by the counters of each port.
+ * \param now The current time on CLOCK_MONOTONIC.
+ */
+static void report_stats(const struct timespec *now) {
+    if (sender_table_report(&senders, now) == 0)
+        return;
+    for (int i = 0; i < nports; i++) {
+        printf("%s ", ports[i].name);
+        print_frame_stats(&ports[i].parser);
     }
+    if (capturing)
+        print_msg("capture: %lu records in %s.%06u, %lu dropped.",
+            capture.records, capture.prefix, capture.segment, capture.dropped);
 }
 
-/** \fn int is_complete_packet(char *packet)
+/** \fn static void handle_packet(lora_port *lp, const unsigned char *buf, int len, const struct timespec *stamp, const struct timespec *mono, capture_record *rec)
  *
- * Check whether a complete packet is received.
- * \param packet The received packet.
- * \return Return -1 on error, a positive 
- *         integer on success.
+ * Account for a frame received from a sender, measure its
+ * one-way latency if it carries a transmit time, and print
+ * its position against the latest fix of the receiver.
+ * \param lp The LoRa module the frame came from.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \param stamp When the frame was read from the port.
+ * \param mono The same on CLOCK_MONOTONIC.
+ * \param rec Where to store what was learnt of the frame,
+ *        for the capture log.
  */
-int is_complete_packet(char *packet) {
-    int cnt = 0;
-    for (int i = 0; *(packet + i) != '\0'; i++)
-        if (*(packet + i) == ',')
-            cnt++;
-    if (cnt != 5)
-        return -1;
-    return cnt;
+static void handle_packet(lora_port *lp, const unsigned char *buf, int len,
+    const struct timespec *stamp, const struct timespec *mono,
+    capture_record *rec) {
+    position_report report;
+    struct timespec fix_stamp;
+    gps_info gps;
+    sender_entry *e;
+    double latitude, longitude;
+    int type;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->rx_time = stamp->tv_sec * 1000000000LL + stamp->tv_nsec;
+    rec->rx_mono = mono->tv_sec * 1000000000LL + mono->tv_nsec;
+    rec->port = lp - ports;
+    rec->len = len;
+    memcpy(rec->payload, buf, len);
+    // Decode the report and account for it in the state of
+    // its sender.
+    if ((e = sender_table_packet(&senders, buf, len, mono,
+        gps_tracker_utc(&tracker, mono), &report, &type)) == NULL)
+        return;
+    rec->flags |= CAPTURE_DECODED;
+    rec->seq_type = type;
+    rec->addr = report.addr;
+    rec->fix_quality = report.fix_quality;
+    rec->seq = report.seq;
+    rec->latitude = report.latitude;
+    rec->longitude = report.longitude;
+    rec->altitude = report.altitude;
+    if (report.time >= 0) {
+        rec->flags |= CAPTURE_TX_TIME;
+        rec->tx_time = report.time;
+    }
+    if (type == SEQ_DUPLICATE)
+        return;
+    latitude = report.latitude / 1e7;
+    longitude = report.longitude / 1e7;
+
+    printf("%s 0x%04x Seq:%5lu at %ld.%06ld, sender's GPS info: (%lf, %lf)\n",
+        lp->name, e->addr, (unsigned long)report.seq, (long)stamp->tv_sec,
+        stamp->tv_nsec / 1000, latitude, longitude);
+    // The latest fix of the receiver, copied from the
+    // tracker thread without waiting.
+    if (gps_tracker_get(&tracker, &gps, &fix_stamp) == 0) {
+        printf("          receiver has no fix yet\n");
+        return;
+    }
+    rec->flags |= CAPTURE_LOCAL_FIX;
+    rec->local_quality = gps.fix_quality;
+    rec->local_latitude = llround(
+        nmea_to_degree(gps.latitude, gps.ns_hemisphere) * 1e7);
+    rec->local_longitude = llround(
+        nmea_to_degree(gps.longitude, gps.ew_hemisphere) * 1e7);
+    rec->local_altitude = llround(gps.altitude * 10);
+    rec->fix_age = (mono->tv_sec - fix_stamp.tv_sec) * 1000000LL +
+        (mono->tv_nsec - fix_stamp.tv_nsec) / 1000;
+    // Compute the distance between the sender and the
+    // latest fix of the receiver.
+    e->distance = get_distance(latitude, longitude, 
+        nmea_to_degree(gps.latitude, gps.ns_hemisphere),
+        nmea_to_degree(gps.longitude, gps.ew_hemisphere));
+    printf("          receiver's GPS info: (%lf, %lf), %.3lf s old\n"
+           "distance: %lf m\n",
+        nmea_to_degree(gps.latitude, gps.ns_hemisphere),
+        nmea_to_degree(gps.longitude, gps.ew_hemisphere),
+        (mono->tv_sec - fix_stamp.tv_sec) +
+        (mono->tv_nsec - fix_stamp.tv_nsec) / 1e9, e->distance);
 }
 
 int main(int argc, char *argv[]) {
-    int lora_fd, gps_fd;
-    char buf[100], param[20], gps_information[100];
+    int gps_fd, epfd, len, n, opt, ubx = FALSE, baud = 0, hz = 0;
+    int tumbling = TUMBLING_WINDOW, sliding = SLIDING_WINDOW;
+    int rset[GATEWAY_MAX_PORTS], keep = 0;
+    const char *prefix = NULL;
+    const unsigned char *buf;
+    capture_record rec;
+    lora_port *lp;
+    struct epoll_event events[GATEWAY_MAX_PORTS];
+    struct timespec stamp, mono;
+    time_t tick = 0;
 
-    if (argc != 3)
+    // Usage: receiver [-u] [-b baud] [-r hz] [-w s] [-s s]
+    //                 [-c prefix [-k n]] lora_port... gps_port
+    // -u: switch the GPS module to UBX binary output.
+    // -b: move the GPS module to a higher baud rate, e.g., 115200.
+    // -r: set the GPS update rate, up to 10 Hz.
+    // -w: report the statistics every s seconds, 20 by default.
+    // -s: also report the last s seconds, 60 by default.
+    // -c: capture the frames received to prefix.000000, ...
+    // -k: keep the last n capture files only.
+    // Several LoRa modules, e.g., on different channels, are
+    // served by one receiver. The modules are provisioned
+    // beforehand, see provision.c.
+    while ((opt = getopt(argc, argv, "ub:r:w:s:c:k:")) != -1) {
+        switch (opt) {
+            case 'w':
+                tumbling = atoi(optarg);
+                break;
+            case 's':
+                sliding = atoi(optarg);
+                break;
+            case 'c':
+                prefix = optarg;
+                break;
+            case 'k':
+                keep = atoi(optarg);
+                break;
+            case 'u':
+                ubx = TRUE;
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 'r':
+                hz = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    nports = argc - optind - 1;
+    if (nports < 1 || nports > GATEWAY_MAX_PORTS)
         error_dump("argument misconfiguration.");
-    if ((lora_fd = raw_receive_init_nparity(argv[1])) < 0)
-        error_dump("fail");
-    if ((gps_fd = raw_receive_init_nparity(argv[2])) < 0)
+    for (int i = 0; i < nports; i++) {
+        open_lora_port(&ports[i], argv[optind + i]);
+        rset[i] = ports[i].fd;
+    }
+    if ((gps_fd = open_gps(argv[argc - 1], ubx, baud, hz)) < 0)
         error_dump("fail");
-    
-    // Install signal handler for signal SIGALRM.
-    if (signal(SIGALRM, sig_alrm) == SIG_ERR)
-        exit(-1);
-
-    // Start alarm timer.
-    alarm(TIMER);
+    // The GPS module is read by a thread of its own, so
+    // that packets are never left waiting for a GPS
+    // sentence.
+    if (gps_tracker_start(&tracker, gps_fd, ubx) < 0)
+        error_dump("fail to start gps tracker.");
+    epfd = init_epoll(rset, nports, NULL, 0);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    if (sender_table_init(&senders, SENDER_TABLE_SIZE, tumbling, sliding,
+        &mono) < 0)
+        error_dump("fail to allocate the sender table.");
+    if (prefix != NULL) {
+        if (capture_open(&capture, prefix, CAPTURE_RECORDS, keep) < 0)
+            error_dump("fail to create the capture log %s.", prefix);
+        capturing = TRUE;
+    }
     
     while (1) {
-        // Block read a packet.
-        if (read_line(lora_fd, buf, 100) < 0)
-            continue;
-        // Check whether this packet is complete.
-        if (is_complete_packet(buf) < 0)
-            continue;
-        // Get the sequence number of this packet.
-        if (get_nth_parameter(buf, 0, param) == NULL)
-            continue;
-        sequence = strtod(param, NULL);
-        // Get the latitude of the sender.
-        if (get_nth_parameter(buf, 1, param) == NULL)
-            continue;
-        latitude = strtod(param, NULL);
-        // Get the longitude of the sender.
-        if (get_nth_parameter(buf, 3, param) == NULL)
-            continue;
-        longitude = strtod(param, NULL);
-        // Get the altitude of the sender.
-        if (get_nth_parameter(buf, 5, param) == NULL)
-            continue;
-        altitude = strtod(param, NULL);
-        // Record the sequence number of the first 
-        // accept packet in this test run.
-        if (first < 0)
-            first = sequence;
-        // Record the sequence number of the last
-        // accept packet in this test run.
-        last = sequence;
-        // Increment the number of accept packets.
-        cnt++;
-        // Get the GPS information of the receiver.
-        while (1) {
-            if (read_raw_gps(gps_fd, gps_information) < 0)
-                error_dump("gps read error");
-            if (is_gpgga(gps_information) == TRUE) {
-                get_gps_info(gps_information, &gps);
-                // Compute the distance between the sender
-                // and the receiver.
-                distance = get_distance(latitude, longitude, 
-                    gps.latitude, gps.longitude);
-                break;
+        // Wake up at least every second to move the
+        // statistics windows.
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        n = epoll_wait(epfd, events, nports, 
+            link_stats_timeout(&senders.origin, &mono));
+        if (n < 0 && errno != EINTR)
+            error_dump("epoll error");
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        report_stats(&mono);
+        // The file work of the capture log is done once a
+        // second, not when a frame fills a file.
+        if (capturing && mono.tv_sec != tick) {
+            capture_maintain(&capture);
+            tick = mono.tv_sec;
+        }
+        for (int i = 0; i < n; i++) {
+            for (lp = ports; lp->fd != events[i].data.fd; lp++) ;
+            // A single read per event, the epoll is level
+            // triggered and reports the rest.
+            if ((len = ring_fill(lp->reader)) == 0)
+                error_dump("%s closed", lp->name);
+            if (len < 0 && errno != EAGAIN && errno != EINTR)
+                error_dump("%s read error", lp->name);
+            clock_gettime(CLOCK_REALTIME, &stamp);
+            clock_gettime(CLOCK_MONOTONIC, &mono);
+            // Frames with a valid CRC, resynchronizing on the
+            // bytes of frames that fail their checks.
+            while ((len = frame_parser_next(&lp->parser, lp->reader, &buf)) >= 0) {
+                handle_packet(lp, buf, len, &stamp, &mono, &rec);
+                if (capturing)
+                    capture_append(&capture, &rec);
             }
         }
-        printf("Seq:%5ld, sender's GPS info: (%lf, %lf)\n"
-               "          receiver's GPS info: (%lf, %lf)\n"
-               "distance: %lf m\n",
-            sequence, latitude, longitude, gps.latitude, 
-            gps.longitude, distance);
     }
     return 0;
-}
\ No newline at end of file
+}
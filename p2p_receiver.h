@@ -7,38 +7,49 @@
 #ifndef _P2P_RECEIVER_H
 #define _P2P_RECEIVER_H
 
+#include <time.h>                   // Timestamps of packets
 #include "header.h"
 #include "io_ops.h"                 // I/O functions
 #include "serial_port_config.h"     // Configure serial port
 #include "as32_config.h"            // Configure AS-32 LoRa module
 #include "gps_analyzer.h"           // Get GPS information
+#include "ubx.h"                    // UBX binary protocol
+#include "lora_payload.h"           // Binary packet payload
+#include "lora_frame.h"             // Framing on the serial link
+#include "gps_tracker.h"            // GPS module in a background thread
+#include "seq_tracker.h"            // Loss, duplicates and reordering
+#include "link_stats.h"             // Windowed link statistics
+#include "sender_table.h"           // State of each sender
+#include "latency_hist.h"           // One-way latency
+#include "capture_log.h"            // Binary log of frames received
 
-#define TIMER 20  /**< The time (in seconds) to compute
-                   * packet reception rate.
-                   */
+#define GATEWAY_MAX_PORTS 8   //< The most LoRa modules served.
 
-// The number of accepted packets in a run (TIMER seconds).
-static int       cnt = 0;
-// The sequence number of the first accepted packet in a test run.
-static int       first = -1;
-// The sequence number of the last accepted packet in a test run.
-static int       last = -1;
-// The sequence number of the currently accepted packet.
-static long      sequence;
-// The latitude of the sender.
-static double    latitude;
-// The longitude of the sender.
-static double    longitude;
-// The altitude of the sender.
-static double    altitude;
-// The packet reception rate of this test run.
-static double    prr;
-// The GPS information of receiver.
-static gps_info  gps;
-// The distance between sender and receiver.
-static double    distance;
+/** \typedef lora_port
+ * The context of one LoRa module served by the receiver.
+ */
+typedef struct {
+    const char       *name;      /**< The serial port name */
+    int               fd;        /**< The serial port */
+    ring_reader      *reader;    /**< Ring reader of the port */
+    frame_parser      parser;    /**< Frames on the port */
+} lora_port;
+
+// The LoRa modules served.
+static lora_port   ports[GATEWAY_MAX_PORTS];
+// The number of LoRa modules served.
+static int         nports;
+// The tracker of the GPS module of receiver.
+static gps_tracker tracker;
+// The senders heard on any of the ports.
+static sender_table senders;
+// The capture log, if one is written.
+static capture_log  capture;
+static int          capturing;
 
-static void sig_alrm(int);
-int is_complete_packet(char *);
+static lora_port *open_lora_port(lora_port *, const char *);
+static void report_stats(const struct timespec *);
+static void handle_packet(lora_port *, const unsigned char *, int,
+    const struct timespec *, const struct timespec *, capture_record *);
 
-#endif
\ No newline at end of file
+#endif
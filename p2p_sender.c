@@ -11,46 +11,40 @@
  *                 |
  *                 v
  *        --------------------
- *    -->|   send a packet    |
+ *    -->| wait for the slot  |
+ *    |  | of the next packet |
  *    |   --------------------
- *    |_____________|
+ *    |            |
+ *    |            v
+ *    |   --------------------
+ *    |  | send a packet with |
+ *    |  | the latest fix     |
+ *    |   --------------------
+ *    |____________|
+ *
+ * Packets are sent at a configured rate, which is
+ * independent of the GPS update rate. A packet is held
+ * when the packets before took their share of the time on
+ * the air, see tx_pacer_take(), so that the module buffer
+ * is not overrun and a duty cycle limit is kept.
+ *
+ * A packet is a frame, see lora_frame.c, around a binary 
+ * position report, which is a keyframe every few packets 
+ * and a delta from that keyframe otherwise:
  *
- * A packet consists of sequence number and GPS
- * information. Its formation is listed as follow:
+ * -------------------------------------------------
+ * | sync word | length | position report | CRC-16 |
+ * -------------------------------------------------
  *
- * ---------------------------------------------------------...
- * | sequence number, latitude, hesisphere (north or south),
- * ---------------------------------------------------------...
+ * The fields of keyframes and deltas are laid out in
+ * lora_payload.c.
  *
- * ...-------------------------------------------------
- *     longitude, hesisphere (west or east), altitude |
- * ...-------------------------------------------------
+ * The former comma separated ASCII packet is still built by
+ * p2p_test_packet() to report the bytes saved.
  */
-#include <sys/time.h>    // For time operations
 #include <string.h>      // For strlen()
 #include "p2p_sender.h"
 
-
-/** \fn struct timeval time_difference(struct timeval *restrict e, struct timeval *restrict b)
- * 
- * Calculate the time elapse between time e and time b.
- * \param e The end time, which is greater than time b.
- * \param b The beginning time.
- * \return Return the time elapse.
- */
-struct timeval time_difference(struct timeval *restrict e,
-    struct timeval *restrict b) {
-    struct timeval diff;
-    if (e->tv_usec > b->tv_usec)
-        diff.tv_usec = e->tv_usec - b->tv_usec;
-    else {
-        e->tv_sec--;
-        diff.tv_usec = 1000000 - b->tv_usec + e->tv_usec;
-    }
-    diff.tv_sec = e->tv_sec - b->tv_sec;
-    return diff;
-}
-
 /** \fn void add_address(char *buf)
  *
  * Add the LoRa network address to the head of this 
@@ -108,115 +102,217 @@ char *itoa(int num, char *str) {
     return str;
 }
 
-/** \fn char *p2p_test_packet(char *packet, int seq, char *gps_info)
+/** \fn char *p2p_test_packet(char *packet, int seq, const gps_info *pg)
  *
  * Create a packet according to GPS information and sequence
- * number.
+ * number. The GPS information may come from NMEA sentences
+ * or UBX messages.
  * \param packet The address of packet to tbe created.
  * \param seq The sequence number of this packet.
- * \param gps_info The GPS information of this sender.
+ * \param pg The GPS information of this sender.
  * \return Return the address of this packet.
  */
-char *p2p_test_packet(char *packet, int seq, char *gps_info) {
-    char str[20];
-    int len;
-
-    itoa(seq, str);
-    len = strlen(strcpy(packet, str));
-    packet[len++] = ',';
-    packet[len] = '\0';
-
-    if (get_latitude(gps_info, str) == NULL)
-        return NULL;
-    len += strlen(strcpy(packet + len, str));
-    packet[len++] = ',';
-    packet[len] = '\0';
-
-    if (get_ns_hemisphere(gps_info, str) == NULL)
-        return NULL;
-    len += strlen(strcpy(packet + len, str));
-    packet[len++] = ',';
-    packet[len] = '\0';
-
-    if (get_longitude(gps_info, str) == NULL)
-        return NULL;
-    len += strlen(strcpy(packet + len, str));
-    packet[len++] = ',';
-    packet[len] = '\0';
+char *p2p_test_packet(char *packet, int seq, const gps_info *pg) {
+    // Hemispheres are empty before the first fix.
+    char ns[2] = { pg->ns_hemisphere, '\0' };
+    char ew[2] = { pg->ew_hemisphere, '\0' };
 
-    if (get_ew_hemisphere(gps_info, str) == NULL)
+    if (snprintf(packet, BUF_SIZE, "%d,%.5lf,%s,%.5lf,%s,%.1lf\n",
+        seq, pg->latitude, ns, pg->longitude, ew, pg->altitude) >= BUF_SIZE)
         return NULL;
-    len += strlen(strcpy(packet + len, str));
-    packet[len++] = ',';
-    packet[len] = '\0';
-
-    if (get_altitude(gps_info, str) == NULL)
-        return NULL;
-    len += strlen(strcpy(packet + len, str));
-    packet[len++] = '\n';
-    packet[len] = '\0';
 
     return packet;
 }
 
-/** \fn int p2p_send_packet(int lora_fd, char *packet)
+/** \fn int p2p_send_packet(int lora_fd, const unsigned char *packet, int len)
  *
- * Send a packet through LoRa module.
+ * Send a packet through LoRa module as a single frame,
+ * written at once.
  * \param lora_fd The file descriptor of the LoRa 
  *        serial port.
  * \param packet The address of the packet to be sent.
+ * \param len The length of the packet, at most LORA_LIMIT.
+ * \return Returns -1 on error, or the number of bytes
+ *         written including framing.
  */
-int p2p_send_packet(int lora_fd, char *packet) {
-    int cnt = 0, len;
-    char lora_packet[10];
-    while (cnt < strlen(packet)) {
-        memset(lora_packet, '\0', sizeof(lora_packet));
-        strncpy(lora_packet, packet + cnt, LORA_LIMIT);
- //       add_address(lora_packet);
-        change_vmin(lora_fd, strlen(lora_packet));
-        printf("%s - %ld\n",lora_packet, strlen(lora_packet));
-        write(lora_fd, lora_packet, strlen(lora_packet));
-        cnt += LORA_LIMIT;
-    }
-    return cnt;
+int p2p_send_packet(int lora_fd, const unsigned char *packet, int len) {
+    return send_frame(lora_fd, packet, len);
 }
 
-int p2p_sender(int lora_fd, int gps_fd, int num) {
-    char gps_info[BUF_SIZE], buf[BUF_SIZE];
-    int seq = 0, cnt;
-    struct timeval begin, end, interval;
+/** \fn static void print_payload_report(long bytes, long ascii, int num)
+ *
+ * Print the average packet size, and the airtime at the 
+ * configured air rate, against the ASCII packet.
+ * \param bytes The bytes of binary packets sent.
+ * \param ascii The bytes the same ASCII packets would take.
+ * \param num The number of packets.
+ */
+static void print_payload_report(long bytes, long ascii, int num) {
+    if (num == 0 || ascii == 0)
+        return;
+    // Times on air of packets of the mean sizes.
+    printf("---->payload: %.1lf bytes/packet (ASCII %.1lf), "
+           "airtime: %.1lf ms/packet (ASCII %.1lf ms) at %d bps, "
+           "%.0lf%% saved\n",
+        (double)bytes / num, (double)ascii / num,
+        as32_time_on_air(SPEED, (bytes + num / 2) / num) / 1e6,
+        as32_time_on_air(SPEED, (ascii + num / 2) / num) / 1e6,
+        as32_air_rate(SPEED), 100.0 * (ascii - bytes) / ascii);
+}
 
+/** \fn int p2p_sender(int lora_fd, gps_tracker *tracker, int64_t period, int interval, int addr, double share)
+ *
+ * Send a packet with the latest GPS fix every period,
+ * starting on the first fix, within a share of the time
+ * on the air.
+ * \param lora_fd The file descriptor of the LoRa 
+ *        serial port.
+ * \param tracker The tracker of the GPS module.
+ * \param period The inter-packet gap in nanoseconds.
+ * \param interval Packets per keyframe.
+ * \param addr The address of this sender.
+ * \param share The fraction of the time on the air.
+ */
+int p2p_sender(int lora_fd, gps_tracker *tracker, int64_t period,
+    int interval, int addr, double share) {
+    char buf[BUF_SIZE];
+    unsigned char packet[PAYLOAD_MAX_SIZE];
+    int seq = 0, len, n, num;
+    long bytes, ascii;
+    unsigned long fixes, last = 0, reused;
+    gps_info fix;
+    position_report report;
+    position_encoder encoder;
+    tx_scheduler sched;
+    tx_pacer pacer;
+    struct timespec now;
+    int64_t utc;
+    ring_counters ring;
+    nmea_stats nmea;
+
+    // Report about once a second, and at least every ten
+    // packets.
+    num = NSEC_PER_SEC / period;
+    if (num < 10)
+        num = 10;
+    position_encoder_init(&encoder, interval);
+    report.addr = addr;
+    if (gps_tracker_wait(tracker, &fix, NULL) == 0)
+        error_dump("gps read error");
+    if (tx_scheduler_init(&sched, period) < 0)
+        error_dump("fail to start the scheduler.");
+    // The bucket holds the time on air of a full module
+    // buffer, in the largest frames.
+    if (tx_pacer_init(&pacer, share, AS32_BUFFER_SIZE / FRAME_MAX_SIZE *
+        as32_time_on_air(SPEED, FRAME_MAX_SIZE)) < 0)
+        error_dump("fail to start the pacer.");
     while (1) {
-        gettimeofday(&begin, NULL);
-        for (int i = 0; i < num;) {
-            if (read_raw_gps(gps_fd, gps_info) < 0)
+        bytes = ascii = reused = 0;
+        for (int i = 0; i < num; i++) {
+            if (tx_scheduler_wait(&sched) < 0)
+                error_dump("scheduler error");
+            // The fix is read by the tracker thread, and only
+            // copied here. It is reused when packets are sent
+            // faster than the GPS update rate.
+            if (gps_tracker_failed(tracker))
                 error_dump("gps read error");
-            if (is_gpgga(gps_info) == TRUE) {
-                p2p_test_packet(buf, seq++, gps_info);
-                p2p_send_packet(lora_fd, buf);
-                write(STDOUT_FILENO, "--->", 4);
-                write(STDOUT_FILENO, buf, strlen(buf));
-                i++;
-            }
+            if ((fixes = gps_tracker_get(tracker, &fix, NULL)) == last)
+                reused++;
+            last = fixes;
+            gps_to_report(&fix, seq, &report);
+            // Stamp the packet with the GPS time of day, for
+            // the receiver to measure the latency.
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((utc = gps_tracker_utc(tracker, &now)) >= 0)
+                report.time = utc / 1000;
+            len = encode_report(&encoder, packet, &report);
+            tx_pacer_take(&pacer, as32_time_on_air(SPEED,
+                len + FRAME_OVERHEAD), len);
+            if ((n = p2p_send_packet(lora_fd, packet, len)) < 0)
+                error_dump("lora write error");
+            bytes += n;
+            if (p2p_test_packet(buf, seq, &fix) != NULL)
+                ascii += strlen(buf);
+            printf("--->%d, %.7lf, %.7lf, %.1lf\n", seq, 
+                report.latitude / 1e7, report.longitude / 1e7,
+                report.altitude / 10.0);
+            seq++;
         }
-        gettimeofday(&end, NULL);
-        interval = time_difference(&end, &begin);
-        printf("---->time elapse: %d s %d ms\n", 
-            (int)interval.tv_sec, (int)interval.tv_usec);
+        tx_scheduler_report(&sched);
+        tx_pacer_report(&pacer);
+        printf("---->fixes reused: %lu of %d packets\n", reused, num);
+        print_payload_report(bytes, ascii, num);
+        // The counters are updated by the tracker thread,
+        // which publishes a copy with every fix.
+        gps_tracker_counters(tracker, &ring, &nmea);
+        print_ring_counters(&ring);
+        if (!tracker->ubx)
+            print_nmea_counters(&nmea);
     }
     return 0;
 }
 
 int main(int argc, char *argv[]) {
-    int lora_fd, gps_fd;
-    if (argc != 3)
+    int lora_fd, gps_fd, opt, ubx = FALSE, baud = 0, hz = 0;
+    int interval = KEYFRAME_INTERVAL, addr = ADDH << 8 | ADDL;
+    int64_t period = NSEC_PER_SEC;
+    double duty = 100;
+    gps_tracker tracker;
+
+    // Usage: sender [-u] [-b baud] [-r hz] [-k n] [-p rate | -g ms]
+    //               [-a addr] [-d percent] lora_port gps_port
+    // -u: switch the GPS module to UBX binary output.
+    // -b: move the GPS module to a higher baud rate, e.g., 115200.
+    // -r: set the GPS update rate, up to 10 Hz.
+    // -k: send a keyframe every n packets, 1 for no deltas.
+    // -p: send rate packets per second, 1 by default.
+    // -g: send a packet every ms milliseconds.
+    // -a: the address of this sender, ADDH and ADDL by default.
+    // -d: the duty cycle limit in percent, e.g., 1, none by
+    //     default. The time on the air is kept below
+    //     TX_PACER_LOAD percent too.
+    while ((opt = getopt(argc, argv, "ub:r:k:p:g:a:d:")) != -1) {
+        switch (opt) {
+            case 'd':
+                duty = atof(optarg);
+                break;
+            case 'a':
+                addr = strtol(optarg, NULL, 0);
+                break;
+            case 'p':
+                period = atof(optarg) > 0 ? NSEC_PER_SEC / atof(optarg) : 0;
+                break;
+            case 'g':
+                period = atof(optarg) * 1e6;
+                break;
+            case 'k':
+                interval = atoi(optarg);
+                break;
+            case 'u':
+                ubx = TRUE;
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 'r':
+                hz = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (argc - optind != 2 || period <= 0 || addr < 0 || addr >= 0xffff ||
+        duty <= 0 || duty > 100)
         error_dump("argument misconfiguration.");
-    if ((lora_fd = raw_send_init_nparity(argv[1])) < 0)
+    if ((lora_fd = raw_send_init_nparity(argv[optind])) < 0)
         error_dump("fail");
-    if ((gps_fd = raw_receive_init_nparity(argv[2])) < 0)
+    if ((gps_fd = open_gps(argv[optind + 1], ubx, baud, hz)) < 0)
         error_dump("fail");
+    if (gps_tracker_start(&tracker, gps_fd, ubx) < 0)
+        error_dump("fail to start gps tracker.");
 
-    p2p_sender(lora_fd, gps_fd, 10);
+    p2p_sender(lora_fd, &tracker, period, interval, addr,
+        (duty < TX_PACER_LOAD ? duty : TX_PACER_LOAD) / 100);
 
     return 0;
-}
\ No newline at end of file
+}
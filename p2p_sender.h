@@ -12,8 +12,14 @@
 #include "serial_port_config.h"     // Configure serial port
 #include "as32_config.h"            // Configure AS-32 LoRa module
 #include "gps_analyzer.h"           // Get GPS information
+#include "ubx.h"                    // UBX binary protocol
+#include "lora_payload.h"           // Binary packet payload
+#include "lora_frame.h"             // Framing on the serial link
+#include "gps_tracker.h"            // GPS module in a background thread
+#include "tx_scheduler.h"           // Transmit pacing
 
-#define LORA_LIMIT 1      /**< The maximal number of characters
+#define LORA_LIMIT FRAME_MAX_PAYLOAD  
+                          /**< The maximal number of payload bytes
                                 that can be sent via a single LoRa
                                 packet. If we transmit a packet whose
                                 size is greater than this value, we
@@ -21,12 +27,11 @@
                                 receive a complete packet.
                             */
 
-struct timeval time_difference(struct timeval *restrict, struct timeval *restrict);
 void add_address(char *);
 char *str_reverse(char *);
 char *itoa(int num, char *);
-char *p2p_test_packet(char *, int, char *);
-int p2p_send_packet(int, char *);
-int p2p_sender(int, int, int);
+char *p2p_test_packet(char *, int, const gps_info *);
+int p2p_send_packet(int, const unsigned char *, int);
+int p2p_sender(int, gps_tracker *, int64_t, int, int, double);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+/** \file payload_check.c
+ *
+ * Check of the keyframes and deltas of the binary payload
+ * on lossy streams, without any module attached.
+ *
+ * A stream of reports, a fix walking a few meters from
+ * packet to packet, goes through encode_report() as in
+ * the sender, and the packets not lost through
+ * decode_report() as in the receiver. Every keyframe
+ * received and every delta whose keyframe was received
+ * should decode to the report sent, and every delta whose
+ * keyframe was lost should be dropped. Packets are lost in
+ * one of CHECK_KINDS ways:
+ *
+ * - random: CHECK_LOST percent of the packets, any of
+ *   them, while the fix quality changes now and then.
+ * - keyframes: every keyframe after a received one, up to
+ *   and including the one 256 keyframe intervals later,
+ *   CHECK_SPANS times, which is the span over which the
+ *   low byte of the keyframe sequence number comes back.
+ *
+ * Both are checked with KEYFRAME_INTERVAL and with
+ * CHECK_LONG_INTERVAL packets per keyframe.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include "payload_check.h"
+
+/** \fn static void check_report(position_report *pr, int kind)
+ *
+ * Move a report on to the next packet.
+ * \param pr The report of the packet before.
+ * \param kind How packets are lost, CHECK_RANDOM, ...
+ */
+static void check_report(position_report *pr, int kind) {
+    pr->seq++;
+    pr->latitude += rand() % 201 - 100;
+    pr->longitude += rand() % 201 - 100;
+    pr->altitude += rand() % 21 - 10;
+    // A change of the fix quality takes a keyframe out of
+    // turn, which would move the keyframes off the spans.
+    if (kind == CHECK_RANDOM && rand() % 500 == 0)
+        pr->fix_quality = 1 + rand() % 2;
+    pr->time = (pr->time + 333) % MS_PER_DAY;
+}
+
+/** \fn static int check_equal(const position_report *a, const position_report *b)
+ *
+ * Tell whether two reports are the same.
+ */
+static int check_equal(const position_report *a, const position_report *b) {
+    return a->addr == b->addr && a->seq == b->seq &&
+        a->latitude == b->latitude && a->longitude == b->longitude &&
+        a->altitude == b->altitude && a->fix_quality == b->fix_quality &&
+        a->time == b->time;
+}
+
+/** \fn static int check_lost(int kind, int keyframe, uint32_t seq, int span)
+ *
+ * Tell whether a packet is lost.
+ * \param kind How packets are lost, CHECK_RANDOM, ...
+ * \param keyframe Whether the packet is a keyframe.
+ * \param seq The sequence number of the packet.
+ * \param span Packets of 256 keyframe intervals.
+ * \return Returns TRUE if the packet is lost.
+ */
+static int check_lost(int kind, int keyframe, uint32_t seq, int span) {
+    if (kind == CHECK_RANDOM)
+        return rand() % 100 < CHECK_LOST;
+    // The keyframe at the start of an odd span is received,
+    // and those after it up to the next span are lost.
+    return keyframe && (seq - 1) / span % 2 == 1 &&
+        (seq - 1) / span < 2 * CHECK_SPANS;
+}
+
+/** \fn static void check_stream(int interval, int kind, check_counters *c)
+ *
+ * Send a stream through the encoder and the decoder,
+ * losing some of the packets, and check what is decoded.
+ * \param interval Packets per keyframe.
+ * \param kind How packets are lost, CHECK_RANDOM, ...
+ * \param c Where to count what the stream went through.
+ */
+static void check_stream(int interval, int kind, check_counters *c) {
+    unsigned char buf[PAYLOAD_MAX_SIZE];
+    position_encoder pe;
+    position_decoder pd;
+    position_report sent, got;
+    int span = 256 * interval, packets, len, keyframe, key_received = FALSE;
+
+    packets = kind == CHECK_RANDOM ? npackets : (2 * CHECK_SPANS + 1) * span;
+    position_encoder_init(&pe, interval);
+    position_decoder_init(&pd);
+    memset(c, 0, sizeof(*c));
+    // Near the end of the UTC day, and a little off the
+    // equator, so that the time wraps and the latitude
+    // changes hemisphere.
+    sent.addr = 0x0102;
+    sent.seq = 0;
+    sent.latitude = -2000;
+    sent.longitude = 1213050200;
+    sent.altitude = 125;
+    sent.fix_quality = 1;
+    sent.time = MS_PER_DAY - 5000;
+
+    for (int i = 0; i < packets; i++, check_report(&sent, kind)) {
+        len = encode_report(&pe, buf, &sent);
+        keyframe = (buf[0] & 0x0f) == PAYLOAD_POSITION;
+        c->sent++;
+        if (check_lost(kind, keyframe, sent.seq, span)) {
+            c->lost++;
+            if (keyframe)
+                key_received = FALSE;
+            continue;
+        }
+        if (keyframe)
+            key_received = TRUE;
+        if (decode_report(&pd, buf, len, &got) < 0) {
+            if (key_received)
+                c->missed++;
+            else
+                c->dropped++;
+        } else if (key_received && check_equal(&got, &sent))
+            c->decoded++;
+        else
+            c->wrong++;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char *kinds[CHECK_KINDS] = { "random", "keyframes" };
+    int intervals[2] = { KEYFRAME_INTERVAL, CHECK_LONG_INTERVAL };
+    check_counters c;
+    unsigned seed = 1;
+    int opt, failed = 0;
+
+    // Usage: payload_check [-n packets] [-s seed]
+    // -n: packets of a stream with random losses,
+    //     CHECK_PACKETS by default.
+    // -s: the seed of the losses, 1 by default.
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                npackets = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (npackets < 1)
+        error_dump("argument misconfiguration.");
+
+    srand(seed);
+    for (int i = 0; i < 2; i++)
+        for (int kind = 0; kind < CHECK_KINDS; kind++) {
+            check_stream(intervals[i], kind, &c);
+            print_msg("interval %3d, %-9s lost: %lu sent, %lu lost, "
+                      "%lu decoded, %lu dropped, %lu wrong, %lu missed.",
+                intervals[i], kinds[kind], c.sent, c.lost, c.decoded,
+                c.dropped, c.wrong, c.missed);
+            failed += c.wrong > 0 || c.missed > 0 || c.decoded == 0;
+        }
+    return failed > 0 ? ERROR : OK;
+}
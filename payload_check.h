@@ -0,0 +1,44 @@
+/** \file payload_check.h
+ *
+ * Function declarations for the check of the keyframes
+ * and deltas of the binary payload on lossy streams.
+ */
+
+#ifndef PAYLOAD_CHECK_H
+#define PAYLOAD_CHECK_H
+
+#include "header.h"
+#include "lora_payload.h"           // Binary payload of LoRa packets
+
+#define CHECK_PACKETS   100000      //< Packets of a stream by default.
+#define CHECK_LOST      20          //< Percent of packets lost at random.
+#define CHECK_SPANS     4           //< Keyframe outages of a stream.
+#define CHECK_LONG_INTERVAL 128     //< A long keyframe interval, as with -k.
+
+// Ways packets are lost.
+#define CHECK_RANDOM    0           //< Any packet, at random.
+#define CHECK_KEYFRAMES 1           //< Every keyframe over spans of 256
+                                    //< keyframe intervals.
+#define CHECK_KINDS     2
+
+/** \typedef check_counters
+ * What a stream went through.
+ */
+typedef struct {
+    unsigned long   sent;       /**< Packets sent */
+    unsigned long   lost;       /**< Packets lost */
+    unsigned long   decoded;    /**< Reports decoded, and right */
+    unsigned long   dropped;    /**< Deltas of a keyframe lost, dropped */
+    unsigned long   wrong;      /**< Reports decoded, but wrong */
+    unsigned long   missed;     /**< Reports not decoded, but decodable */
+} check_counters;
+
+// Packets of a stream.
+static int npackets = CHECK_PACKETS;
+
+static void check_report(position_report *, int);
+static int check_equal(const position_report *, const position_report *);
+static int check_lost(int, int, uint32_t, int);
+static void check_stream(int, int, check_counters *);
+
+#endif
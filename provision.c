@@ -0,0 +1,232 @@
+/** \file provision.c
+ *
+ * Provisioning of many LoRa modules at once, e.g., on a
+ * USB hub before deployment.
+ *
+ * Each module is served by a worker thread of its own,
+ * which brings it to the parameters with configure_as32(),
+ * reads its parameters and version back, and verifies
+ * them. The modules wait for their answers in parallel, so
+ * the batch takes about as long as the slowest module.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <glob.h>
+#include <time.h>
+#include "provision.h"
+
+/** \fn static double elapsed(const struct timespec *start)
+ *
+ * Get the seconds since a time on CLOCK_MONOTONIC.
+ */
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+        (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/** \fn static int find_ports(char *ports[], int size)
+ *
+ * Find the serial ports of USB adapters attached.
+ * \param ports Where to store the port names.
+ * \param size The most ports stored.
+ * \return Returns the number of ports found.
+ */
+static int find_ports(char *ports[], int size) {
+    static const char *patterns[] = { "/dev/ttyUSB*", "/dev/ttyACM*" };
+    glob_t g;
+    int n = 0;
+
+    for (int i = 0; i < 2; i++) {
+        if (glob(patterns[i], 0, NULL, &g) != 0)
+            continue;
+        for (size_t j = 0; j < g.gl_pathc && n < size; j++)
+            if ((ports[n] = strdup(g.gl_pathv[j])) != NULL)
+                n++;
+        globfree(&g);
+    }
+    return n;
+}
+
+/** \fn static const char *provision_module(provision_job *job, int fd)
+ *
+ * Bring a module to the parameters of its job, and read
+ * its parameters and version back.
+ * \param job The job of the module.
+ * \param fd The serial port of the module.
+ * \return Returns NULL on success, or what failed.
+ */
+static const char *provision_module(provision_job *job, int fd) {
+    unsigned char want[PARAM_SIZE], got[PARAM_SIZE];
+    as32_param wanted;
+    int written, len;
+
+    if ((written = configure_as32(fd, &job->want, PERSIST)) < 0)
+        return "cannot configure the module";
+    // Read back what the module keeps, whether it was
+    // written or not.
+    encode_as32_param(&job->want, PERSIST, want);
+    if (read_as32_param(fd, (char *)got) < 0 ||
+        decode_as32_param(got, &job->got) < 0)
+        return "no parameters read back";
+    decode_as32_param(want, &wanted);
+    if (!equal_as32_param(&job->got, &wanted))
+        return "parameters differ";
+    if ((len = read_as32_version(fd, job->version)) < 0)
+        return "no version read";
+    job->version[len] = '\0';
+    job->result = written ? PROVISION_CONFIGURED : PROVISION_UNCHANGED;
+    return NULL;
+}
+
+/** \fn static void *provision_worker(void *arg)
+ *
+ * Provision a module and verify it.
+ * \param arg The provision_job of the module.
+ * \return Always returns NULL.
+ */
+static void *provision_worker(void *arg) {
+    provision_job *job = arg;
+    struct timespec start;
+    int fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    job->result = PROVISION_FAILED;
+    if ((fd = raw_recv_send_open_nparity(job->port)) < 0)
+        job->error = "cannot open the port";
+    else {
+        job->error = provision_module(job, fd);
+        close(fd);
+    }
+    // The counters are those of this thread.
+    job->stats = *get_as32_stats();
+    job->seconds = elapsed(&start);
+    return NULL;
+}
+
+/** \fn static void print_job(const provision_job *job)
+ *
+ * Print a row of the summary table.
+ */
+static void print_job(const provision_job *job) {
+    static const char *results[3] = { "FAILED", "unchanged", "configured" };
+    char version[VERSION_SIZE + 1];
+    int i;
+
+    // Versions are not always text.
+    for (i = 0; job->version[i] != '\0'; i++)
+        version[i] = isprint((unsigned char)job->version[i]) ?
+            job->version[i] : '.';
+    version[i] = '\0';
+    if (job->result == PROVISION_FAILED) {
+        print_msg("%-16s %-10s %-48s %7.3lf %4lu %4lu %4lu", job->port,
+            results[job->result], job->error, job->seconds,
+            job->stats.commands, job->stats.retries, job->stats.timeouts);
+        return;
+    }
+    print_msg("%-16s %-10s 0x%04x %4d %6d %3d %-18s %6.3lf %7.3lf %4lu %4lu %4lu",
+        job->port, results[job->result], job->got.addr, job->got.chan,
+        job->got.air_rate, job->got.power, version,
+        job->stats.answered ? job->stats.sum / 1e3 / job->stats.answered : 0.0,
+        job->seconds, job->stats.commands, job->stats.retries,
+        job->stats.timeouts);
+}
+
+int main(int argc, char *argv[]) {
+    char *ports[PROVISION_MAX_PORTS];
+    unsigned char cmd[PARAM_SIZE];
+    as32_param want;
+    struct timespec start;
+    double slowest = 0;
+    int opt, addr = -1, found = FALSE, count[3] = { 0, 0, 0 };
+
+    // Usage: provision [-a addr] [-c chan] [-r air_rate] [-p dbm]
+    //                  [port...]
+    // -a: give the modules the addresses addr, addr + 1, ...
+    //     in the order of the ports, ADDH and ADDL by default.
+    // -c: the channel, CHAN by default.
+    // -r: the air rate in bps, that of SPEED by default.
+    // -p: the transmit power in dBm, that of OPTION by default.
+    // Without ports, every USB serial port attached is
+    // provisioned. The modules should be in configuration
+    // mode, M0 and M1 high: in normal mode, they send the
+    // commands over the air.
+    default_as32_param(&want);
+    while ((opt = getopt(argc, argv, "a:c:r:p:")) != -1) {
+        switch (opt) {
+            case 'a':
+                addr = strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                want.chan = atoi(optarg);
+                break;
+            case 'r':
+                want.air_rate = atoi(optarg);
+                break;
+            case 'p':
+                want.power = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (optind < argc) {
+        njobs = argc - optind;
+        if (njobs > PROVISION_MAX_PORTS)
+            error_dump("argument misconfiguration.");
+        for (int i = 0; i < njobs; i++)
+            ports[i] = argv[optind + i];
+    } else {
+        njobs = find_ports(ports, PROVISION_MAX_PORTS);
+        found = TRUE;
+    }
+    if (njobs == 0)
+        error_dump("no serial port found.");
+    if (addr >= 0)
+        want.addr = addr;
+    for (int i = 0; i < njobs; i++) {
+        jobs[i].port = ports[i];
+        jobs[i].want = want;
+        jobs[i].want.addr = addr >= 0 ? want.addr + i : want.addr;
+    }
+    if (encode_as32_param(&want, PERSIST, cmd) < 0 ||
+        jobs[njobs - 1].want.addr > 0xffff)
+        error_dump("argument misconfiguration.");
+    printf("provisioning %d modules: ", njobs);
+    print_as32_param(&want);
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < njobs; i++) {
+        if (pthread_create(&jobs[i].thread, NULL, provision_worker,
+            &jobs[i]) != 0)
+            error_dump("fail to start a worker.");
+        jobs[i].started = TRUE;
+    }
+    for (int i = 0; i < njobs; i++)
+        if (jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+
+    print_msg("%-16s %-10s %-6s %4s %6s %3s %-18s %6s %7s %4s %4s %4s",
+        "port", "result", "addr", "chan", "air", "dBm", "version",
+        "resp", "time", "cmds", "retr", "tmo");
+    for (int i = 0; i < njobs; i++) {
+        print_job(&jobs[i]);
+        count[jobs[i].result]++;
+        if (jobs[i].seconds > slowest)
+            slowest = jobs[i].seconds;
+    }
+    print_msg("%d modules: %d configured, %d unchanged, %d failed in "
+              "%.3lf s, the slowest taking %.3lf s.",
+        njobs, count[PROVISION_CONFIGURED], count[PROVISION_UNCHANGED],
+        count[PROVISION_FAILED], elapsed(&start), slowest);
+    if (found)
+        for (int i = 0; i < njobs; i++)
+            free(ports[i]);
+    return count[PROVISION_FAILED] > 0 ? ERROR : OK;
+}
@@ -0,0 +1,48 @@
+/** \file provision.h
+ *
+ * Type definitions and function declarations for the
+ * provisioning of many LoRa modules at once.
+ */
+
+#ifndef PROVISION_H
+#define PROVISION_H
+
+#include <pthread.h>                // Workers
+#include "header.h"
+#include "serial_port_config.h"     // Configure serial port
+#include "as32_config.h"            // Configure AS-32 LoRa module
+
+#define PROVISION_MAX_PORTS 64      //< The most modules provisioned at once.
+
+// Results of a module.
+#define PROVISION_FAILED     0      //< The module is not provisioned.
+#define PROVISION_UNCHANGED  1      //< The module had the parameters.
+#define PROVISION_CONFIGURED 2      //< The parameters were written.
+
+/** \typedef provision_job
+ * The provisioning of one module by a worker thread.
+ */
+typedef struct {
+    const char *port;        /**< The serial port */
+    pthread_t   thread;      /**< The worker */
+    int         started;     /**< Whether the worker was started */
+    as32_param  want;        /**< The parameters to provision */
+    int         result;      /**< PROVISION_FAILED, ... */
+    const char *error;       /**< What failed, if anything */
+    as32_param  got;         /**< The parameters read back */
+    char        version[VERSION_SIZE + 1];  /**< The version read */
+    double      seconds;     /**< Time taken */
+    as32_stats  stats;       /**< Commands of the worker */
+} provision_job;
+
+// The modules being provisioned.
+static provision_job jobs[PROVISION_MAX_PORTS];
+// The number of modules.
+static int           njobs;
+
+static int find_ports(char *[], int);
+static const char *provision_module(provision_job *, int);
+static void *provision_worker(void *);
+static void print_job(const provision_job *);
+
+#endif
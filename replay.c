@@ -0,0 +1,296 @@
+/** \file replay.c
+ *
+ * Replay of recorded input through the receive path, as a
+ * repeatable benchmark and regression check without any
+ * module attached.
+ *
+ * Three kinds of input are replayed, told apart by their
+ * first bytes:
+ *
+ * - NMEA logs, e.g., cat /dev/ttyUSB1 > gps.log, which go
+ *   through read_gps_fix() as in the GPS tracker thread.
+ * - LoRa byte captures, e.g., cat /dev/ttyUSB0 > lora.bin,
+ *   which go through the frame parser and the sender table
+ *   as in the receiver.
+ * - Capture logs written by receiver -c, whose payloads go
+ *   through the sender table at their original times.
+ *
+ * Input is replayed as fast as possible, or with -p, paced
+ * to the UTC times of the fixes and the receive times of
+ * capture records. LoRa byte captures have no times, and
+ * their packets are stamped with the time of the replay.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include "replay.h"
+
+/** \fn static int64_t elapsed_ns(const struct timespec *start)
+ *
+ * Get the nanoseconds since a time on CLOCK_MONOTONIC.
+ */
+static int64_t elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000LL +
+        (now.tv_nsec - start->tv_nsec);
+}
+
+/** \fn static int replay_kind(const char *path)
+ *
+ * Tell the kind of an input by its first bytes.
+ * \param path The input.
+ * \return Returns -1 on error, or REPLAY_NMEA, ...
+ */
+static int replay_kind(const char *path) {
+    char head[8];
+    int fd, n;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return ERROR;
+    n = read(fd, head, sizeof(head));
+    close(fd);
+    if (n < 0)
+        return ERROR;
+    if (n == sizeof(head) && memcmp(head, CAPTURE_MAGIC, sizeof(head)) == 0)
+        return REPLAY_CAPTURE;
+    if (n > 0 && head[0] == '$')
+        return REPLAY_NMEA;
+    return REPLAY_LORA;
+}
+
+/** \fn static void replay_pace(const struct timespec *start, int64_t offset)
+ *
+ * Sleep until the time of an input, if the replay is
+ * paced.
+ * \param start When the replay started, on CLOCK_MONOTONIC.
+ * \param offset Nanoseconds of the input since its start.
+ */
+static void replay_pace(const struct timespec *start, int64_t offset) {
+    struct timespec until;
+
+    if (!paced || offset <= 0)
+        return;
+    offset += start->tv_nsec;
+    until.tv_sec = start->tv_sec + offset / 1000000000LL;
+    until.tv_nsec = offset % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0)
+        ;
+}
+
+/** \fn static void replay_packet(const unsigned char *buf, int len, const struct timespec *now, replay_counters *c)
+ *
+ * Feed a payload to the sender table, as the receiver does
+ * on each valid frame.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \param now When the payload was received.
+ * \param c The counters of the replay.
+ */
+static void replay_packet(const unsigned char *buf, int len,
+    const struct timespec *now, replay_counters *c) {
+    position_report report;
+    int type;
+
+    // The time is kept from going back, e.g., between the
+    // inputs of different runs.
+    if (!started) {
+        if (sender_table_init(&senders, SENDER_TABLE_SIZE, tumbling, sliding,
+            now) < 0)
+            error_dump("fail to allocate the sender table.");
+        started = TRUE;
+        last = *now;
+        tick = last.tv_sec;
+    } else if (now->tv_sec > last.tv_sec ||
+        (now->tv_sec == last.tv_sec && now->tv_nsec > last.tv_nsec))
+        last = *now;
+    // Windows only move on whole seconds, and the table is
+    // scanned as the receiver does, once a second.
+    if (last.tv_sec != tick) {
+        sender_table_report(&senders, &last);
+        tick = last.tv_sec;
+    }
+    c->packets++;
+    if (sender_table_packet(&senders, buf, len, &last, -1, &report,
+        &type) != NULL)
+        c->decoded++;
+}
+
+/** \fn static int replay_nmea(const char *path, replay_counters *c)
+ *
+ * Replay an NMEA log.
+ * \param path The log.
+ * \param c The counters of the replay.
+ * \return Returns -1 on error, 0 otherwise.
+ */
+static int replay_nmea(const char *path, replay_counters *c) {
+    const nmea_stats *ns = get_nmea_stats();
+    unsigned long before;
+    struct timespec start;
+    ring_reader *r;
+    gps_info gps;
+    int64_t first = -1, offset;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return ERROR;
+    // The ring reader of the descriptor may be left over
+    // from an input closed before, with its bytes.
+    if ((r = get_ring_reader(fd)) == NULL) {
+        close(fd);
+        return ERROR;
+    }
+    ring_reader_init(r, fd);
+    memset(&gps, 0, sizeof(gps));
+    before = ns->accepted + ns->bad_checksum + ns->no_checksum +
+        ns->malformed;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (read_gps_fix(fd, &gps) == NMEA_GGA) {
+        c->fixes++;
+        if (!paced)
+            continue;
+        // Fixes are spaced by their UTC times, across
+        // midnight too.
+        offset = nmea_time_to_us(gps.utc_time);
+        if (first < 0)
+            first = offset;
+        if ((offset -= first) < 0)
+            offset += MS_PER_DAY * 1000LL;
+        replay_pace(&start, offset * 1000);
+    }
+    c->seconds = elapsed_ns(&start) / 1e9;
+    c->sentences = ns->accepted + ns->bad_checksum + ns->no_checksum +
+        ns->malformed - before;
+    c->bytes = r->nbytes;
+    close(fd);
+    return OK;
+}
+
+/** \fn static int replay_lora(const char *path, replay_counters *c)
+ *
+ * Replay the bytes read from a LoRa module.
+ * \param path The capture.
+ * \param c The counters of the replay.
+ * \return Returns -1 on error, 0 otherwise.
+ */
+static int replay_lora(const char *path, replay_counters *c) {
+    frame_parser parser;
+    ring_reader *r;
+    const unsigned char *buf;
+    struct timespec start, now;
+    int fd, len;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return ERROR;
+    if ((r = get_ring_reader(fd)) == NULL) {
+        close(fd);
+        return ERROR;
+    }
+    ring_reader_init(r, fd);
+    frame_parser_init(&parser);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((len = read_frame(&parser, r, &buf)) >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        replay_packet(buf, len, &now, c);
+    }
+    c->seconds = elapsed_ns(&start) / 1e9;
+    c->bytes = r->nbytes;
+    printf("%s ", path);
+    print_frame_stats(&parser);
+    close(fd);
+    return OK;
+}
+
+/** \fn static int replay_capture(const char *path, replay_counters *c)
+ *
+ * Replay a capture log of the receiver.
+ * \param path The capture log.
+ * \param c The counters of the replay.
+ * \return Returns -1 on error, 0 otherwise.
+ */
+static int replay_capture(const char *path, replay_counters *c) {
+    capture_reader r;
+    const capture_record *rec;
+    struct timespec start, now;
+    int64_t first = -1;
+
+    if (capture_reader_open(&r, path) < 0)
+        return ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((rec = capture_reader_next(&r)) != NULL) {
+        if (first < 0)
+            first = rec->rx_mono;
+        replay_pace(&start, rec->rx_mono - first);
+        now.tv_sec = rec->rx_mono / 1000000000LL;
+        now.tv_nsec = rec->rx_mono % 1000000000LL;
+        replay_packet(rec->payload, rec->len, &now, c);
+        c->bytes += rec->len;
+    }
+    c->seconds = elapsed_ns(&start) / 1e9;
+    capture_reader_close(&r);
+    return OK;
+}
+
+int main(int argc, char *argv[]) {
+    replay_counters c;
+    int opt, kind, nmea = FALSE;
+
+    // Usage: replay [-p] [-w s] [-s s] input...
+    // -p: pace the input to its original times.
+    // -w: report the statistics every s seconds of input,
+    //     20 by default.
+    // -s: also report the last s seconds, 60 by default.
+    while ((opt = getopt(argc, argv, "pw:s:")) != -1) {
+        switch (opt) {
+            case 'p':
+                paced = TRUE;
+                break;
+            case 'w':
+                tumbling = atoi(optarg);
+                break;
+            case 's':
+                sliding = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (optind >= argc)
+        error_dump("argument misconfiguration.");
+
+    for (int i = optind; i < argc; i++) {
+        memset(&c, 0, sizeof(c));
+        if ((kind = replay_kind(argv[i])) < 0)
+            error_dump("fail to open %s.", argv[i]);
+        if (kind == REPLAY_NMEA) {
+            if (replay_nmea(argv[i], &c) < 0)
+                error_dump("fail to replay %s.", argv[i]);
+            nmea = TRUE;
+            print_msg("%s: %lu sentences, %lu fixes in %.3lf s, "
+                      "%.0lf sentences/s, %.1lf MB/s.",
+                argv[i], c.sentences, c.fixes, c.seconds,
+                c.seconds > 0 ? c.sentences / c.seconds : 0.0,
+                c.seconds > 0 ? c.bytes / c.seconds / 1e6 : 0.0);
+            continue;
+        }
+        if ((kind == REPLAY_LORA ? replay_lora(argv[i], &c) :
+            replay_capture(argv[i], &c)) < 0)
+            error_dump("fail to replay %s.", argv[i]);
+        print_msg("%s: %lu packets, %lu decoded in %.3lf s, "
+                  "%.0lf packets/s, %.1lf MB/s.",
+            argv[i], c.packets, c.decoded, c.seconds,
+            c.seconds > 0 ? c.packets / c.seconds : 0.0,
+            c.seconds > 0 ? c.bytes / c.seconds / 1e6 : 0.0);
+    }
+    if (nmea)
+        print_nmea_stats();
+    // Close the last window of statistics.
+    if (started) {
+        last.tv_sec += tumbling;
+        sender_table_report(&senders, &last);
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+/** \file replay.h
+ *
+ * Function declarations for the replay of recorded GPS
+ * and LoRa input through the receive path.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <time.h>                   // Timestamps of records
+#include "header.h"
+#include "io_ops.h"                 // Ring reader
+#include "gps_analyzer.h"           // NMEA parsing
+#include "lora_frame.h"             // Framing on the serial link
+#include "capture_log.h"            // Binary log of frames received
+#include "sender_table.h"           // State of each sender
+
+// Kinds of input, told apart by their first bytes.
+#define REPLAY_NMEA     0     //< NMEA sentences as read from the GPS module.
+#define REPLAY_LORA     1     //< Bytes as read from the LoRa module.
+#define REPLAY_CAPTURE  2     //< A capture log of the receiver.
+
+/** \typedef replay_counters
+ * What a replay went through, for the throughput report.
+ */
+typedef struct {
+    unsigned long   bytes;      /**< Bytes of input */
+    unsigned long   sentences;  /**< NMEA sentences */
+    unsigned long   fixes;      /**< GGA fixes */
+    unsigned long   packets;    /**< LoRa payloads */
+    unsigned long   decoded;    /**< Payloads decoded */
+    double          seconds;    /**< Time spent */
+} replay_counters;
+
+// Whether to sleep to the spacing of the original input.
+static int          paced;
+// Whether the sender table is initialized.
+static int          started;
+// The senders found in the LoRa input.
+static sender_table senders;
+// Seconds per tumbling and sliding window.
+static int          tumbling = TUMBLING_WINDOW, sliding = SLIDING_WINDOW;
+// The latest time of the LoRa input.
+static struct timespec last;
+// The second of the last report of the sender table.
+static time_t       tick;
+
+static int replay_kind(const char *);
+static void replay_pace(const struct timespec *, int64_t);
+static void replay_packet(const unsigned char *, int, const struct timespec *,
+    replay_counters *);
+static int replay_nmea(const char *, replay_counters *);
+static int replay_lora(const char *, replay_counters *);
+static int replay_capture(const char *, replay_counters *);
+
+#endif
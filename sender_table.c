@@ -0,0 +1,270 @@
+/** \file sender_table.c
+ *
+ * Function definitions for the state a receiver keeps
+ * about each sender.
+ */
+
+#include <stdlib.h>          // For malloc(), calloc(), free().
+#include "header.h"
+#include "sender_table.h"
+
+/** \fn static unsigned sender_hash(const sender_table *t, uint16_t addr)
+ *
+ * Get the home slot of an address, by Fibonacci hashing,
+ * so that nearby addresses are spread over the table.
+ */
+static unsigned sender_hash(const sender_table *t, uint16_t addr) {
+    return ((uint32_t)addr * 0x9e3779b1u) & (t->size - 1);
+}
+
+/** \fn int sender_table_init(sender_table *t, int size, int tumbling, int sliding, const struct timespec *now)
+ *
+ * Initialize an empty table of senders.
+ * \param t The table.
+ * \param size The number of slots, a power of 2.
+ * \param tumbling Seconds per tumbling window of a sender.
+ * \param sliding Seconds per sliding window of a sender.
+ * \param now The current time on CLOCK_MONOTONIC, where the
+ *        windows of every sender start.
+ * \return Returns -1 on error, 0 on success.
+ */
+int sender_table_init(sender_table *t, int size, int tumbling, int sliding,
+    const struct timespec *now) {
+    if (size <= 0 || (size & (size - 1)) != 0)
+        return ERROR;
+    t->size = size;
+    t->count = 0;
+    t->tumbling = tumbling;
+    t->sliding = sliding;
+    t->origin = *now;
+    t->overflow = 0;
+    t->removed = 0;
+    // Entries are only touched when a sender is admitted,
+    // so calloc() leaves the pages of free slots unused.
+    if ((t->keys = malloc(size * sizeof(uint16_t))) == NULL)
+        return ERROR;
+    if ((t->entries = calloc(size, sizeof(sender_entry))) == NULL) {
+        free(t->keys);
+        return ERROR;
+    }
+    for (int i = 0; i < size; i++)
+        t->keys[i] = SENDER_EMPTY;
+    return OK;
+}
+
+/** \fn sender_entry *sender_table_find(const sender_table *t, uint16_t addr)
+ *
+ * Find a sender.
+ * \return Returns NULL if the sender is unknown, or its entry.
+ */
+sender_entry *sender_table_find(const sender_table *t, uint16_t addr) {
+    unsigned i = sender_hash(t, addr);
+
+    while (t->keys[i] != SENDER_EMPTY) {
+        if (t->keys[i] == addr)
+            return &t->entries[i];
+        i = (i + 1) & (t->size - 1);
+    }
+    return NULL;
+}
+
+/** \fn sender_entry *sender_table_get(sender_table *t, uint16_t addr, const struct timespec *now)
+ *
+ * Find a sender, admitting it if it is unknown.
+ * \param t The table.
+ * \param addr The address of the sender.
+ * \param now The current time on CLOCK_MONOTONIC.
+ * \return Returns NULL if the table is full, memory is
+ *         short or the address is SENDER_EMPTY, or the
+ *         entry of the sender.
+ */
+sender_entry *sender_table_get(sender_table *t, uint16_t addr,
+    const struct timespec *now) {
+    unsigned i = sender_hash(t, addr);
+    sender_entry *e;
+
+    while (t->keys[i] != SENDER_EMPTY) {
+        if (t->keys[i] == addr)
+            return &t->entries[i];
+        i = (i + 1) & (t->size - 1);
+    }
+    if (addr == SENDER_EMPTY || (t->count + 1) * 4 > t->size * 3) {
+        t->overflow++;
+        return NULL;
+    }
+    e = &t->entries[i];
+    if ((e->latency = malloc(sizeof(latency_hist))) == NULL)
+        return NULL;
+    if (link_stats_init(&e->stats, t->tumbling, t->sliding, &t->origin) < 0) {
+        free(e->latency);
+        return NULL;
+    }
+    t->keys[i] = addr;
+    t->count++;
+    e->addr = addr;
+    e->has_position = FALSE;
+    position_decoder_init(&e->decoder);
+    seq_tracker_init(&e->seq);
+    latency_hist_clear(e->latency);
+    // The windows of a new sender line up with those of the
+    // others.
+    link_stats_advance(&e->stats, now);
+    e->stats.window = e->stats.second - e->stats.second % e->stats.tumbling;
+    return e;
+}
+
+/** \fn static void sender_table_remove(sender_table *t, unsigned i)
+ *
+ * Remove the sender of a slot. The entries after it in its
+ * probe run that may go to the slot are shifted back, so
+ * that every sender stays reachable from its home slot.
+ * \param t The table.
+ * \param i The slot of the sender.
+ */
+static void sender_table_remove(sender_table *t, unsigned i) {
+    unsigned mask = t->size - 1, j = i, home;
+
+    link_stats_free(&t->entries[i].stats);
+    free(t->entries[i].latency);
+    while (t->keys[j = (j + 1) & mask] != SENDER_EMPTY) {
+        // The entry of slot j may go to slot i unless its
+        // home is in (i, j].
+        home = sender_hash(t, t->keys[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            t->keys[i] = t->keys[j];
+            t->entries[i] = t->entries[j];
+            i = j;
+        }
+    }
+    t->keys[i] = SENDER_EMPTY;
+    t->count--;
+    t->removed++;
+}
+
+/** \fn sender_entry *sender_table_packet(sender_table *t, const unsigned char *buf, int len, const struct timespec *now, int64_t utc, position_report *pr, int *type)
+ *
+ * Account for a payload received: admit its sender, decode
+ * the report, and update the sequence tracker, statistics
+ * and latency of the sender. This is the whole receive
+ * path after framing, shared by the receiver and the
+ * replay tool.
+ * \param t The table.
+ * \param buf The payload.
+ * \param len The payload length.
+ * \param now When the payload was received, on
+ *        CLOCK_MONOTONIC.
+ * \param utc The GPS time of day of the receiver in
+ *        microseconds, -1 if unknown.
+ * \param pr Where to store the report decoded.
+ * \param type Where to store SEQ_IN_ORDER, ...
+ * \return Returns NULL if the payload was not decoded, or
+ *         the entry of the sender.
+ */
+sender_entry *sender_table_packet(sender_table *t, const unsigned char *buf,
+    int len, const struct timespec *now, int64_t utc, position_report *pr,
+    int *type) {
+    sender_entry *e;
+    uint32_t skipped;
+    int addr;
+
+    // The state of the sender, which is admitted on its
+    // first packet.
+    if ((addr = payload_source(buf, len)) < 0 ||
+        (e = sender_table_get(t, addr, now)) == NULL)
+        return NULL;
+    // Deltas whose keyframe was lost are dropped, and so is
+    // a sender admitted on such a packet, which is likely
+    // noise.
+    if (decode_report(&e->decoder, buf, len, pr) < 0) {
+        if (!e->stats.started)
+            sender_table_remove(t, e - t->entries);
+        return NULL;
+    }
+    *type = seq_tracker_update(&e->seq, pr->seq, &skipped);
+    link_stats_packet(&e->stats, now, *type, skipped, len);
+    if (*type == SEQ_DUPLICATE)
+        return e;
+    e->last = *pr;
+    e->has_position = TRUE;
+    // Both ends take the time of day from their GPS modules,
+    // so the difference is the one-way latency, within the
+    // output delay of the modules. It is wrapped around
+    // midnight.
+    if (pr->time >= 0 && utc >= 0) {
+        utc -= pr->time * 1000LL;
+        if (utc > MS_PER_DAY * 500LL)
+            utc -= MS_PER_DAY * 1000LL;
+        else if (utc < -MS_PER_DAY * 500LL)
+            utc += MS_PER_DAY * 1000LL;
+        latency_hist_record(e->latency, utc);
+    }
+    return e;
+}
+
+/** \fn int sender_table_report(sender_table *t, const struct timespec *now)
+ *
+ * Move the statistics windows of every sender to the
+ * current time, and report the windows that are over, with
+ * the sliding windows and the total of all senders.
+ * \param t The table.
+ * \param now The current time on CLOCK_MONOTONIC.
+ * \return Returns 0 if no window is over, or the length of
+ *         the window reported in seconds.
+ */
+int sender_table_report(sender_table *t, const struct timespec *now) {
+    stats_counters window, sliding, total;
+    latency_hist latency;
+    sender_entry *e;
+    char label[16];
+    int seconds = 0, reported = 0;
+
+    // Idle senders go first. A slot is looked at again when
+    // its sender is removed, as another may move into it.
+    for (int i = 0; i < t->size; ) {
+        if (t->keys[i] != SENDER_EMPTY &&
+            now->tv_sec - t->entries[i].stats.arrival.tv_sec >= SENDER_IDLE)
+            sender_table_remove(t, i);
+        else
+            i++;
+    }
+
+    stats_counters_clear(&total);
+    latency_hist_clear(&latency);
+    for (int i = 0; i < t->size; i++) {
+        if (t->keys[i] == SENDER_EMPTY)
+            continue;
+        e = &t->entries[i];
+        if (!link_stats_advance(&e->stats, now))
+            continue;
+        seconds = link_stats_rotate(&e->stats, &window);
+        stats_counters_add(&total, &window);
+        // Senders not heard in this window are left out.
+        if (window.packets + window.duplicates + window.late == 0)
+            continue;
+        snprintf(label, sizeof(label), "0x%04x", e->addr);
+        print_stats_counters(label, &window, seconds);
+        link_stats_sliding(&e->stats, &sliding);
+        // The sliding window is not full in the first seconds.
+        print_stats_counters("  last", &sliding,
+            e->stats.second < e->stats.sliding ?
+            e->stats.second : e->stats.sliding);
+        print_seq_tracker(&e->seq);
+        if (e->latency->count > 0)
+            print_latency_hist(label, e->latency);
+        latency_hist_add(&latency, e->latency);
+        latency_hist_clear(e->latency);
+        reported++;
+    }
+    if (seconds == 0)
+        return 0;
+    if (reported > 1) {
+        print_stats_counters("total", &total, seconds);
+        if (latency.count > 0)
+            print_latency_hist("total", &latency);
+    }
+    if (t->overflow > 0)
+        print_msg("%lu packets of senders beyond the table.", t->overflow);
+    if (t->removed > 0)
+        print_msg("%d senders, %lu removed.", t->count, t->removed);
+    return seconds;
+}
@@ -0,0 +1,73 @@
+/** \file sender_table.h
+ *
+ * Type definitions and function declarations for the state
+ * a receiver keeps about each sender.
+ */
+
+#ifndef _SENDER_TABLE_H
+#define _SENDER_TABLE_H
+
+#include <stdint.h>          // For fixed width integers.
+#include <time.h>            // For struct timespec.
+#include "lora_payload.h"    // position_decoder.
+#include "seq_tracker.h"     // seq_tracker.
+#include "link_stats.h"      // link_stats.
+#include "latency_hist.h"    // latency_hist.
+
+#define SENDER_TABLE_SIZE 1024    //< Slots of a table, a power of 2.
+#define SENDER_EMPTY      0xffff  /*< Marks a free slot, the broadcast
+                                   * address, which no sender has.
+                                   */
+#define SENDER_IDLE       600     /*< Seconds without a packet after
+                                   * which a sender is removed.
+                                   */
+
+/** \typedef sender_entry
+ * The state of one sender. The buckets of the sliding
+ * window and the latency histogram, which are large and
+ * touched once a packet, are allocated apart, so that the
+ * table stays a few hundred bytes a sender.
+ */
+typedef struct {
+    uint16_t         addr;       /**< Sender address, ADDH and ADDL */
+    int              has_position; /**< Whether last holds a report */
+    position_report  last;       /**< The last position reported */
+    double           distance;   /**< Distance at the last report */
+    position_decoder decoder;    /**< Reports of the sender */
+    seq_tracker      seq;        /**< Sequence numbers of the sender */
+    link_stats       stats;      /**< Statistics of the link */
+    latency_hist    *latency;    /**< One-way latency in this window */
+} sender_entry;
+
+/** \typedef sender_table
+ * An open addressing hash table of senders, with linear
+ * probing over an array of addresses only, so that a
+ * lookup touches a cache line or two before the entry.
+ * At most 3/4 of the slots are used so that probes stay
+ * short. A sender whose first packet is not decoded, e.g.,
+ * noise passing the CRC, is removed at once, and a sender
+ * not heard for SENDER_IDLE seconds when the statistics
+ * are reported, so that phantom senders do not fill the
+ * table. Removal shifts the entries after it back, so no
+ * tombstone is left.
+ */
+typedef struct {
+    int             size;       /**< Slots, a power of 2 */
+    int             count;      /**< Senders in the table */
+    int             tumbling;   /**< Seconds per tumbling window */
+    int             sliding;    /**< Seconds per sliding window */
+    struct timespec origin;     /**< When the statistics started */
+    unsigned long   overflow;   /**< Packets of senders not admitted */
+    unsigned long   removed;    /**< Senders removed */
+    uint16_t       *keys;       /**< Addresses, SENDER_EMPTY if free */
+    sender_entry   *entries;    /**< Senders, in the slots of their keys */
+} sender_table;
+
+int sender_table_init(sender_table *, int, int, int, const struct timespec *);
+sender_entry *sender_table_find(const sender_table *, uint16_t);
+sender_entry *sender_table_get(sender_table *, uint16_t, const struct timespec *);
+sender_entry *sender_table_packet(sender_table *, const unsigned char *, int,
+    const struct timespec *, int64_t, position_report *, int *);
+int sender_table_report(sender_table *, const struct timespec *);
+
+#endif
@@ -0,0 +1,175 @@
+/** \file seq_tracker.c
+ *
+ * Function definitions for tracking the sequence numbers
+ * of a sender with a sliding bitmap.
+ *
+ * Bit s % SEQ_WINDOW stands for sequence number s, for s in
+ * the window from highest - SEQ_WINDOW + 1 to highest. As
+ * SEQ_WINDOW divides 2^32, this holds across the wrap of
+ * sequence numbers, which are compared with serial number
+ * arithmetic.
+ */
+
+#include <string.h>          // For memset().
+#include "header.h"
+#include "seq_tracker.h"
+
+/** \fn void seq_tracker_init(seq_tracker *t)
+ *
+ * Initialize the tracker of a sender.
+ */
+void seq_tracker_init(seq_tracker *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+/** \fn static unsigned clear_bits(seq_tracker *t, uint32_t from, unsigned n)
+ *
+ * Clear the bits of n sequence numbers, a word at a time.
+ * \return Returns the number of bits that were set.
+ */
+static unsigned clear_bits(seq_tracker *t, uint32_t from, unsigned n) {
+    unsigned set = 0, pos, bit, k;
+    uint64_t mask;
+
+    while (n > 0) {
+        pos = from & (SEQ_WINDOW - 1);
+        bit = pos & 63;
+        k = 64 - bit < n ? 64 - bit : n;
+        mask = (k == 64 ? ~0ULL : (1ULL << k) - 1) << bit;
+        set += __builtin_popcountll(t->bits[pos >> 6] & mask);
+        t->bits[pos >> 6] &= ~mask;
+        from += k;
+        n -= k;
+    }
+    return set;
+}
+
+/** \fn static void restart(seq_tracker *t, uint32_t seq)
+ *
+ * Start the window at a sequence number. The sequence
+ * numbers before it count as received, so that they are
+ * not taken as lost.
+ */
+static void restart(seq_tracker *t, uint32_t seq) {
+    memset(t->bits, 0xff, sizeof(t->bits));
+    t->first = t->highest = seq;
+    t->started = TRUE;
+    t->received++;
+}
+
+/** \fn static int behind(seq_tracker *t, uint32_t seq, int type)
+ *
+ * Count a packet that is a duplicate or late. A restarted
+ * sender numbers its packets from 0 again, below the
+ * highest sequence number, so that they are taken as
+ * duplicates or late until they go past it. After
+ * SEQ_RESTART_RUN such packets in a row, each above the
+ * previous one, the window starts again at the first of
+ * them, and they are counted as received instead.
+ * \param t The tracker of the sender.
+ * \param seq The sequence number of the packet.
+ * \param type SEQ_DUPLICATE or SEQ_LATE.
+ * \return Returns type, or SEQ_RESTART.
+ */
+static int behind(seq_tracker *t, uint32_t seq, int type) {
+    if (t->run > 0 && (int32_t)(seq - t->run_last) > 0) {
+        t->run++;
+    } else {
+        t->run = 1;
+        t->run_first = seq;
+        t->run_duplicates = 0;
+    }
+    t->run_last = seq;
+    if (type == SEQ_DUPLICATE) {
+        t->duplicates++;
+        t->run_duplicates++;
+    } else {
+        t->late++;
+    }
+    if (t->run < SEQ_RESTART_RUN)
+        return type;
+
+    t->duplicates -= t->run_duplicates;
+    t->late -= t->run - t->run_duplicates;
+    t->lost += seq_tracker_pending(t);
+    t->restarts++;
+    restart(t, seq);
+    t->first = t->run_first;
+    t->received += t->run - 1;
+    t->run = 0;
+    return SEQ_RESTART;
+}
+
+/** \fn int seq_tracker_update(seq_tracker *t, uint32_t seq, uint32_t *skipped)
+ *
+ * Track a packet received from the sender.
+ * \param t The tracker of the sender.
+ * \param seq The sequence number of the packet.
+ * \param skipped Where to store the number of sequence
+ *        numbers skipped by a packet in order, 0 otherwise.
+ * \return Returns SEQ_IN_ORDER, SEQ_REORDERED, SEQ_DUPLICATE,
+ *         SEQ_LATE or SEQ_RESTART.
+ */
+int seq_tracker_update(seq_tracker *t, uint32_t seq, uint32_t *skipped) {
+    int32_t diff = seq - t->highest;
+    unsigned n;
+
+    *skipped = 0;
+    if (!t->started) {
+        restart(t, seq);
+        return SEQ_IN_ORDER;
+    }
+    if (diff > 0) {
+        t->run = 0;
+        // The bits of the new sequence numbers are those of
+        // the ones leaving the window.
+        n = diff < SEQ_WINDOW ? diff : SEQ_WINDOW;
+        t->lost += n - clear_bits(t, t->highest + 1, n) + (diff - n);
+        t->bits[(seq & (SEQ_WINDOW - 1)) >> 6] |= 1ULL << (seq & 63);
+        t->highest = seq;
+        t->received++;
+        *skipped = diff - 1;
+        return SEQ_IN_ORDER;
+    }
+    if (diff <= -SEQ_RESTART_GAP) {
+        t->run = 0;
+        t->lost += seq_tracker_pending(t);
+        t->restarts++;
+        restart(t, seq);
+        return SEQ_RESTART;
+    }
+    if (diff <= -SEQ_WINDOW || (int32_t)(seq - t->first) < 0) {
+        return behind(t, seq, SEQ_LATE);
+    }
+    if (t->bits[(seq & (SEQ_WINDOW - 1)) >> 6] & (1ULL << (seq & 63)))
+        return behind(t, seq, SEQ_DUPLICATE);
+    t->run = 0;
+    t->bits[(seq & (SEQ_WINDOW - 1)) >> 6] |= 1ULL << (seq & 63);
+    t->received++;
+    t->reordered++;
+    return SEQ_REORDERED;
+}
+
+/** \fn unsigned long seq_tracker_pending(const seq_tracker *t)
+ *
+ * Get the number of sequence numbers in the window not
+ * received yet, which are lost unless they come late.
+ */
+unsigned long seq_tracker_pending(const seq_tracker *t) {
+    unsigned long set = 0;
+
+    for (int i = 0; i < SEQ_WINDOW / 64; i++)
+        set += __builtin_popcountll(t->bits[i]);
+    return SEQ_WINDOW - set;
+}
+
+/** \fn void print_seq_tracker(const seq_tracker *t)
+ *
+ * Print the counters of a tracker.
+ */
+void print_seq_tracker(const seq_tracker *t) {
+    print_msg("sequence: %lu received, %lu lost, %lu pending, "
+              "%lu duplicates, %lu reordered, %lu late, %lu restarts.",
+        t->received, t->lost, seq_tracker_pending(t), t->duplicates,
+        t->reordered, t->late, t->restarts);
+}
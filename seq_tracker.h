@@ -0,0 +1,63 @@
+/** \file seq_tracker.h
+ *
+ * Type definitions and function declarations for tracking
+ * the sequence numbers of a sender.
+ */
+
+#ifndef _SEQ_TRACKER_H
+#define _SEQ_TRACKER_H
+
+#include <stdint.h>          // For fixed width integers.
+
+#define SEQ_WINDOW      1024    /*< Sequence numbers below the highest one
+                                 * that are told apart, a power of 2.
+                                 */
+#define SEQ_RESTART_GAP (4 * SEQ_WINDOW)
+                                /*< A packet this far below the highest
+                                 * sequence number means the sender
+                                 * restarted.
+                                 */
+#define SEQ_RESTART_RUN 8       /*< Packets in a row, in order among
+                                 * themselves, that are duplicates or
+                                 * late and mean the sender restarted
+                                 * with fewer packets sent than
+                                 * SEQ_RESTART_GAP.
+                                 */
+
+// What a packet is to the tracker.
+#define SEQ_IN_ORDER    0       //< Above the highest sequence number.
+#define SEQ_REORDERED   1       //< Filling a gap in the window.
+#define SEQ_DUPLICATE   2       //< Received before.
+#define SEQ_LATE        3       //< Below the window, unknown.
+#define SEQ_RESTART     4       //< First packet after a restart.
+
+/** \typedef seq_tracker
+ * A sliding bitmap of the last SEQ_WINDOW sequence numbers
+ * of a sender, as the anti-replay window of IPsec. A
+ * sequence number is lost when it leaves the window without
+ * having been received, so the counters are exact and the
+ * memory is constant, whatever the length of a run.
+ */
+typedef struct {
+    int           started;      /**< Whether a packet was received */
+    uint32_t      first;        /**< The first sequence number */
+    uint32_t      highest;      /**< The highest sequence number */
+    uint64_t      bits[SEQ_WINDOW / 64]; /**< Sequence numbers received */
+    unsigned long received;     /**< Distinct packets received */
+    unsigned long lost;         /**< Sequence numbers that left the window */
+    unsigned long duplicates;   /**< Packets received again */
+    unsigned long reordered;    /**< Packets that filled a gap */
+    unsigned long late;         /**< Packets below the window */
+    unsigned long restarts;     /**< Restarts of the sender */
+    unsigned      run;          /**< Duplicates or late packets in a row */
+    uint32_t      run_first;    /**< The first sequence number of the run */
+    uint32_t      run_last;     /**< The last sequence number of the run */
+    unsigned      run_duplicates; /**< Duplicates counted in the run */
+} seq_tracker;
+
+void seq_tracker_init(seq_tracker *);
+int seq_tracker_update(seq_tracker *, uint32_t, uint32_t *);
+unsigned long seq_tracker_pending(const seq_tracker *);
+void print_seq_tracker(const seq_tracker *);
+
+#endif
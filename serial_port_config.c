@@ -55,87 +55,139 @@ int change_vmin(int fd, int vmin) {
     return OK;
 }
 
-/** \fn int raw_recv_send_init(const char *portname, int length)
- * 
- * Configure a serial port to be capable of reading and writing
- * in the raw I/O mode with a given vmin.
- * The baud rate is set to 9600 bps. No parity check is performed,
- * and the character size is set to 8.
- * 
- * \param portname The serial port name, e.g., /dev/ttyUSB0.
- * \param length The given value of vmin.
+/** \fn speed_t baud_to_speed(int baud)
+ *
+ * Map a baud rate to its termios speed macro.
+ * \param baud The baud rate, e.g., 9600.
+ * \return Returns B0 if the baud rate is not supported, or
+ *         the speed macro, e.g., B9600.
+ */
+speed_t baud_to_speed(int baud) {
+    switch (baud) {
+        case 1200:   return B1200;
+        case 2400:   return B2400;
+        case 4800:   return B4800;
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        default:     return B0;
+    }
+}
+
+/** \fn int change_speed(int fd, int baud)
+ *
+ * Change the input and output baud rate of a given serial
+ * port, after the pending output has been transmitted.
+ * Input received at the old baud rate is discarded.
+ * \param fd File descriptor of a open serial port.
+ * \param baud The new baud rate, e.g., 115200.
  * \return Return 0 on success, -1 on failure.
  */
-int raw_recv_send_init(const char *portname, int length) {
-    int fd;
-    struct termios buf;
+int change_speed(int fd, int baud) {
+    struct termios buf, old;
+    speed_t speed;
 
-    if ((fd = open(portname, O_RDWR | O_NOCTTY)) < 0)
-        error_dump("fail to open serial port!");
+    if ((speed = baud_to_speed(baud)) == B0) {
+        print_msg("unsupported baud rate %d.", baud);
+        return ERROR;
+    }
+    if (tcgetattr(fd, &buf) < 0) {
+        print_msg("fail to get port attributes.");
+        return ERROR;
+    }
+    old = buf;
+
+    cfsetispeed(&buf, speed);
+    cfsetospeed(&buf, speed);
+
+    if (tcsetattr(fd, TCSADRAIN, &buf) < 0) {
+        print_msg("fail to set port attributes.");
+        return ERROR;
+    }
 
     if (tcgetattr(fd, &buf) < 0) {
-        close(fd);
-        switch (errno) {
-            case ENOTTY:
-                error_dump("cannot get serial port attributions,\n"
-                    "or accessing a file that is not a serial port!");
-            default:
-                error_exit(errno);
-        }
+        print_msg("fail to get port attributes.");
+        tcsetattr(fd, TCSANOW, &old);
+        return ERROR;
     }
+ 
+    if (cfgetospeed(&buf) != speed || cfgetispeed(&buf) != speed) {
+        tcsetattr(fd, TCSANOW, &old);
+        print_msg("configuration failure.");
+        return ERROR;
+    }
+    tcflush(fd, TCIFLUSH);
 
-    buf.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
-    buf.c_cflag |= CS8;
-    cfsetospeed(&buf, B9600);
+    return OK;
+}
 
-    buf.c_lflag &= ~(ICANON | ECHO | ECHOE);
+/** \fn static int set_raw_attr(int fd, struct termios *buf, int vmin)
+ *
+ * Set the raw I/O mode with a given vmin on an open serial
+ * port, from its attributes, and check that it is set.
+ * The baud rate is set to 9600 bps. No parity check is performed,
+ * and the character size is set to 8.
+ *
+ * \param fd File descriptor of a open serial port.
+ * \param buf The attributes of the port.
+ * \param vmin The given value of vmin.
+ * \return Return 0 on success, -1 on failure.
+ */
+static int set_raw_attr(int fd, struct termios *buf, int vmin) {
+    buf->c_cflag &= ~(CSIZE | PARENB | CSTOPB);
+    buf->c_cflag |= CS8;
+    cfsetospeed(buf, B9600);
 
-    buf.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // Frames are binary: no byte may be taken as a signal,
+    // translated or stripped.
+    buf->c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
 
-    buf.c_oflag &= ~OPOST;
+    buf->c_iflag &= ~(IXON | IXOFF | IXANY | RAW_IFLAGS);
 
-    buf.c_cc[VMIN] = length;
-    buf.c_cc[VTIME] = 0;
+    buf->c_oflag &= ~OPOST;
 
-    if (tcsetattr(fd, TCSANOW, &buf) < 0) {
-        close(fd);
+    buf->c_cc[VMIN] = vmin;
+    buf->c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, buf) < 0) {
         print_msg("fail to set port attributes.");
         return ERROR;
     }
 
-    if (tcgetattr(fd, &buf) < 0) {
-        close(fd);
+    if (tcgetattr(fd, buf) < 0) {
         print_msg("fail to get port attributes.");
         return ERROR;
     }
  
-    if ((buf.c_cflag & (CSIZE | PARENB | CS8 | CSTOPB)) != CS8 ||
-        (cfgetospeed(&buf) != B9600) ||
-        (buf.c_oflag & OPOST) ||
-        (buf.c_lflag & (ICANON | ECHO | ECHOE)) ||
-        (buf.c_iflag & (IXON | IXOFF | IXANY)) ||
-        (buf.c_cc[VMIN] != length) ||
-        (buf.c_cc[VTIME] != 0)
+    if ((buf->c_cflag & (CSIZE | PARENB | CS8 | CSTOPB)) != CS8 ||
+        (cfgetospeed(buf) != B9600) ||
+        (buf->c_oflag & OPOST) ||
+        (buf->c_lflag & (ICANON | ECHO | ECHOE | ISIG | IEXTEN)) ||
+        (buf->c_iflag & (IXON | IXOFF | IXANY | RAW_IFLAGS)) ||
+        (buf->c_cc[VMIN] != vmin) ||
+        (buf->c_cc[VTIME] != 0)
         ) {
-        close(fd);
         print_msg("configuration failure.");
         return ERROR;
     }
 
-    return fd;
+    return OK;
 }
 
-/** \fn int raw_recv_send_init_nparity(const char *portname)
+/** \fn int raw_recv_send_init(const char *portname, int length)
  * 
  * Configure a serial port to be capable of reading and writing
- * in the raw I/O mode.
+ * in the raw I/O mode with a given vmin.
  * The baud rate is set to 9600 bps. No parity check is performed,
- * and the character size is set to 8. The value of vmin is 1.
+ * and the character size is set to 8.
  * 
  * \param portname The serial port name, e.g., /dev/ttyUSB0.
+ * \param length The given value of vmin.
  * \return Return 0 on success, -1 on failure.
  */
-int raw_recv_send_init_nparity(const char *portname) {
+int raw_recv_send_init(const char *portname, int length) {
     int fd;
     struct termios buf;
 
@@ -153,41 +205,57 @@ int raw_recv_send_init_nparity(const char *portname) {
         }
     }
 
-    buf.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
-    buf.c_cflag |= CS8;
-    cfsetospeed(&buf, B9600);
-
-    buf.c_lflag &= ~(ICANON | ECHO | ECHOE);
+    if (set_raw_attr(fd, &buf, length) < 0) {
+        close(fd);
+        return ERROR;
+    }
 
-    buf.c_iflag &= ~(IXON | IXOFF | IXANY);
+    return fd;
+}
 
-    buf.c_oflag &= ~OPOST;
+/** \fn int raw_recv_send_init_nparity(const char *portname)
+ * 
+ * Configure a serial port to be capable of reading and writing
+ * in the raw I/O mode.
+ * The baud rate is set to 9600 bps. No parity check is performed,
+ * and the character size is set to 8. The value of vmin is 1.
+ * 
+ * \param portname The serial port name, e.g., /dev/ttyUSB0.
+ * \return Return 0 on success, -1 on failure.
+ */
+int raw_recv_send_init_nparity(const char *portname) {
+    return raw_recv_send_init(portname, 1);
+}
 
-    buf.c_cc[VMIN] = 1;
-    buf.c_cc[VTIME] = 0;
+/** \fn int raw_recv_send_open_nparity(const char *portname)
+ *
+ * Configure a serial port as raw_recv_send_init_nparity()
+ * does, but without exiting when the port cannot be opened
+ * or is not a serial port, so that the caller goes on with
+ * other ports.
+ *
+ * \param portname The serial port name, e.g., /dev/ttyUSB0.
+ * \return Return the file descriptor on success, -1 on failure.
+ */
+int raw_recv_send_open_nparity(const char *portname) {
+    int fd;
+    struct termios buf;
 
-    if (tcsetattr(fd, TCSANOW, &buf) < 0) {
-        close(fd);
-        print_msg("fail to set port attributes.");
+    if ((fd = open(portname, O_RDWR | O_NOCTTY)) < 0) {
+        print_msg("fail to open serial port %s: %s.", portname,
+            strerror(errno));
         return ERROR;
     }
 
     if (tcgetattr(fd, &buf) < 0) {
+        print_msg("cannot get the attributes of %s: %s.", portname,
+            strerror(errno));
         close(fd);
-        print_msg("fail to get port attributes.");
         return ERROR;
     }
- 
-    if ((buf.c_cflag & (CSIZE | PARENB | CS8 | CSTOPB)) != CS8 ||
-        (cfgetospeed(&buf) != B9600) ||
-        (buf.c_oflag & OPOST) ||
-        (buf.c_lflag & (ICANON | ECHO | ECHOE)) ||
-        (buf.c_iflag & (IXON | IXOFF | IXANY)) ||
-        (buf.c_cc[VMIN] != 1) ||
-        (buf.c_cc[VTIME] != 0)
-        ) {
+
+    if (set_raw_attr(fd, &buf, 1) < 0) {
         close(fd);
-        print_msg("configuration failure.");
         return ERROR;
     }
 
@@ -346,8 +414,11 @@ int raw_receive_init_nparity(const char *portname) {
      * ECHO: Enable echoing of input characters.
      * ECHOE: Echo erase character as BS-SP-BS.
      * In the raw mode, we simply disable echoing.
+     *
+     * IEXTEN: Enable extended input processing, e.g., VLNEXT,
+     * which would swallow a byte of binary data.
      */
-    buf.c_lflag &= ~(ICANON | ECHO | ECHOE);
+    buf.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
 
     /*
      * Next, we set the input modes member c_iflag, which
@@ -359,8 +430,12 @@ int raw_receive_init_nparity(const char *portname) {
      *
      * IXANY: Allow any character to start flow again. Disabled
      * in this function.
+     *
+     * RAW_IFLAGS: Break, CR and NL translation, 8th bit
+     * stripping and parity marking, which all alter binary
+     * data. Disabled in this function.
      */
-    buf.c_iflag &= ~(IXON | IXOFF | IXANY);
+    buf.c_iflag &= ~(IXON | IXOFF | IXANY | RAW_IFLAGS);
 
     /*
      * Finally, we set timeout configuration.
@@ -418,8 +493,8 @@ int raw_receive_init_nparity(const char *portname) {
  
     if ((buf.c_cflag & (CSIZE | PARENB | CS8 | CSTOPB)) != CS8 ||
         (cfgetospeed(&buf) != B9600) ||
-        (buf.c_lflag & (ICANON | ECHO | ECHOE)) ||
-        (buf.c_iflag & (IXON | IXOFF | IXANY)) ||
+        (buf.c_lflag & (ICANON | ECHO | ECHOE | ISIG | IEXTEN)) ||
+        (buf.c_iflag & (IXON | IXOFF | IXANY | RAW_IFLAGS)) ||
         (buf.c_cc[VMIN] != 1) ||
         (buf.c_cc[VTIME] != 0)
         ) {
@@ -528,10 +603,14 @@ int raw_send_init_nparity(const char *portname) {
     buf.c_oflag &= ~OPOST;
 
     /*
-     * Because we only configure this serial port to send data,
-     * we need not to setting its input feature, i.e., c_iflag,
-     * c_lflag and c_cc array.
+     * Although this serial port only sends data, the terminal
+     * still takes in what the module receives, and would echo
+     * it back to the module, which sends it on the air again.
+     * So echoing and input processing are disabled as for the
+     * receiving ports, see raw_receive_init_nparity().
      */
+    buf.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    buf.c_iflag &= ~(IXON | IXOFF | IXANY | RAW_IFLAGS);
 
     /*
      * To enable our configuration, we call the tcsetattr()
@@ -577,6 +656,8 @@ int raw_send_init_nparity(const char *portname) {
      */
     if ((buf.c_cflag & (CSIZE | PARENB | CS8)) != CS8 ||
         (buf.c_oflag & OPOST) ||
+        (buf.c_lflag & (ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN)) ||
+        (buf.c_iflag & (IXON | IXOFF | IXANY | RAW_IFLAGS)) ||
         (cfgetospeed(&buf) != B9600)
         ) {
         close(fd);
@@ -13,6 +13,14 @@
 #include <errno.h>     /* Error number definitions */
 #include <termios.h>   /* POSIX termina control definition */
 
+/*
+ * Input processing cleared on ports carrying binary data:
+ * break to SIGINT or NUL, CR and NL translation, 8th bit
+ * stripping, and parity checking and marking.
+ */
+#define RAW_IFLAGS (BRKINT | IGNBRK | ICRNL | INLCR | IGNCR | ISTRIP | \
+                    INPCK | PARMRK)
+
 static struct termios     save_termios;
 int init_serial_port(const char *);
 int raw_send_init_nparity(const char *);
@@ -20,7 +28,10 @@ int raw_send_init_parity(const char *);
 int raw_receive_init_nparity(const char *);
 int raw_receive_init_parity(const char *);
 int raw_recv_send_init_nparity(const char *);
+int raw_recv_send_open_nparity(const char *);
 int raw_recv_send_init(const char *, int);
 int change_vmin(int, int);
+speed_t baud_to_speed(int);
+int change_speed(int, int);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+/** \file tx_scheduler.c
+ *
+ * Function definitions for pacing transmissions with a
+ * timer, independently of the GPS update rate, and with a
+ * token bucket of time on the air.
+ */
+
+#include <string.h>          // For memset().
+#include <unistd.h>          // For read(), close().
+#include <sys/timerfd.h>     // For timerfd_create(), timerfd_settime().
+#include "header.h"
+#include "tx_scheduler.h"
+
+/** \fn int64_t timespec_diff(const struct timespec *e, const struct timespec *b)
+ *
+ * Compute e - b in nanoseconds.
+ */
+int64_t timespec_diff(const struct timespec *e, const struct timespec *b) {
+    return (int64_t)(e->tv_sec - b->tv_sec) * NSEC_PER_SEC +
+        (e->tv_nsec - b->tv_nsec);
+}
+
+/** \fn int tx_scheduler_init(tx_scheduler *s, int64_t period)
+ *
+ * Arm a scheduler, whose first slot is one period from now.
+ * \param s The scheduler.
+ * \param period The inter-packet gap in nanoseconds.
+ * \return Returns -1 on error, 0 on success.
+ */
+int tx_scheduler_init(tx_scheduler *s, int64_t period) {
+    struct itimerspec its;
+
+    if (period <= 0) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    memset(s, 0, sizeof(*s));
+    s->period = period;
+    if ((s->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+        return ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &s->begin);
+    s->start = s->begin;
+    s->start.tv_sec += (s->start.tv_nsec + period) / NSEC_PER_SEC;
+    s->start.tv_nsec = (s->start.tv_nsec + period) % NSEC_PER_SEC;
+
+    its.it_value = s->start;
+    its.it_interval.tv_sec = period / NSEC_PER_SEC;
+    its.it_interval.tv_nsec = period % NSEC_PER_SEC;
+    if (timerfd_settime(s->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        close(s->fd);
+        return ERROR;
+    }
+    return OK;
+}
+
+/** \fn int64_t tx_scheduler_wait(tx_scheduler *s)
+ *
+ * Wait for the next slot. When slots expired during the
+ * previous send, the wait returns at once, and only the
+ * latest slot is served.
+ * \param s The scheduler.
+ * \return Returns -1 on error, or the delay in nanoseconds
+ *         between the latest slot and the wake-up.
+ */
+int64_t tx_scheduler_wait(tx_scheduler *s) {
+    struct timespec now;
+    uint64_t n;
+    int64_t delay;
+
+    while (read(s->fd, &n, sizeof(n)) < 0)
+        if (errno != EINTR)
+            return ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    s->missed += n - 1;
+    s->ticks += n;
+    delay = timespec_diff(&now, &s->start) - (int64_t)(s->ticks - 1) * s->period;
+
+    s->sent++;
+    s->jitter_sum += delay;
+    if (delay > s->jitter_max)
+        s->jitter_max = delay;
+    return delay;
+}
+
+/** \fn void tx_scheduler_report(tx_scheduler *s)
+ *
+ * Print the achieved rate against the target rate, and the
+ * wake-up delays, since the last report, then start a new
+ * report.
+ */
+void tx_scheduler_report(tx_scheduler *s) {
+    struct timespec now;
+    int64_t elapse;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapse = timespec_diff(&now, &s->begin);
+    if (elapse > 0 && s->sent > 0)
+        printf("---->rate: %.2lf packets/s (target %.2lf) over %.3lf s, "
+               "jitter: mean %.3lf ms, max %.3lf ms, missed slots: %lu\n",
+            s->sent * 1e9 / elapse, 1e9 / s->period, elapse / 1e9,
+            s->jitter_sum / 1e6 / s->sent, s->jitter_max / 1e6, s->missed);
+    s->begin = now;
+    s->sent = 0;
+    s->jitter_sum = s->jitter_max = 0;
+}
+
+/** \fn int tx_pacer_init(tx_pacer *p, double share, int64_t depth)
+ *
+ * Start a pacer with a full bucket.
+ * \param p The pacer.
+ * \param share The fraction of the time on the air, e.g.,
+ *        0.01 for a duty cycle of 1%.
+ * \param depth The bucket size in nanoseconds on the air,
+ *        e.g., the time the buffer of the module takes, so
+ *        that a burst does not overrun it.
+ * \return Returns -1 on error, 0 on success.
+ */
+int tx_pacer_init(tx_pacer *p, double share, int64_t depth) {
+    if (share <= 0 || share > 1 || depth <= 0) {
+        errno = EINVAL;
+        return ERROR;
+    }
+    memset(p, 0, sizeof(*p));
+    p->share = share;
+    p->depth = p->tokens = depth;
+    clock_gettime(CLOCK_MONOTONIC, &p->last);
+    p->begin = p->last;
+    return OK;
+}
+
+/** \fn static void tx_pacer_fill(tx_pacer *p)
+ *
+ * Add the tokens earned since they were last added.
+ */
+static void tx_pacer_fill(tx_pacer *p) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    p->tokens += timespec_diff(&now, &p->last) * p->share;
+    if (p->tokens > p->depth)
+        p->tokens = p->depth;
+    p->last = now;
+}
+
+/** \fn int64_t tx_pacer_take(tx_pacer *p, int64_t airtime, int bytes)
+ *
+ * Take the time on air of a packet from the bucket, and
+ * wait for the tokens missing, if any.
+ * \param p The pacer.
+ * \param airtime The time on air of the packet in
+ *        nanoseconds, see as32_time_on_air().
+ * \param bytes The payload bytes of the packet.
+ * \return Returns the nanoseconds waited.
+ */
+int64_t tx_pacer_take(tx_pacer *p, int64_t airtime, int bytes) {
+    struct timespec delay;
+    int64_t wait = 0;
+
+    tx_pacer_fill(p);
+    if (p->tokens < airtime) {
+        wait = (airtime - p->tokens) / p->share;
+        delay.tv_sec = wait / NSEC_PER_SEC;
+        delay.tv_nsec = wait % NSEC_PER_SEC;
+        while (nanosleep(&delay, &delay) < 0 && errno == EINTR)
+            ;
+        tx_pacer_fill(p);
+        p->waits++;
+        p->wait_sum += wait;
+    }
+    // Oversleeping leaves no debt, and rounding only a
+    // little.
+    p->tokens -= airtime;
+    p->packets++;
+    p->airtime += airtime;
+    p->bytes += bytes;
+    return wait;
+}
+
+/** \fn void tx_pacer_report(tx_pacer *p)
+ *
+ * Print the goodput achieved against the theoretical one,
+ * i.e., that of packets of the same sizes sent back to
+ * back within the share of the time on the air, since the
+ * last report, then start a new report.
+ */
+void tx_pacer_report(tx_pacer *p) {
+    struct timespec now;
+    int64_t elapse;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapse = timespec_diff(&now, &p->begin);
+    if (elapse > 0 && p->airtime > 0)
+        printf("---->goodput: %.1lf bps (theoretical %.1lf), air time: "
+               "%.1lf%% (limit %.1lf%%), held: %lu packets, mean %.3lf ms\n",
+            p->bytes * 8e9 / elapse, p->bytes * 8e9 * p->share / p->airtime,
+            100.0 * p->airtime / elapse, 100 * p->share, p->waits,
+            p->waits ? p->wait_sum / 1e6 / p->waits : 0.0);
+    p->begin = now;
+    p->packets = p->waits = 0;
+    p->wait_sum = p->airtime = p->bytes = 0;
+}
@@ -0,0 +1,64 @@
+/** \file tx_scheduler.h
+ *
+ * Type definitions and function declarations for pacing
+ * transmissions with a timer and a token bucket.
+ */
+
+#ifndef _TX_SCHEDULER_H
+#define _TX_SCHEDULER_H
+
+#include <stdint.h>          // For fixed width integers.
+#include <time.h>            // For struct timespec.
+
+#define NSEC_PER_SEC 1000000000L
+#define TX_PACER_LOAD 90     /*< Percent of the time on the air used at
+                              * most, just below the link capacity.
+                              */
+
+/** \typedef tx_scheduler
+ * A periodic timerfd on CLOCK_MONOTONIC. Slots are kept
+ * on an absolute grid, so that a late send does not push
+ * the following ones back.
+ */
+typedef struct {
+    int             fd;         /**< The timerfd */
+    int64_t         period;     /**< Inter-packet gap in nanoseconds */
+    struct timespec start;      /**< When the first slot expires */
+    uint64_t        ticks;      /**< Slots expired so far */
+    unsigned long   missed;     /**< Slots missed by late waits */
+    // Counters of the current report.
+    struct timespec begin;      /**< Start of the report */
+    unsigned long   sent;       /**< Slots served */
+    int64_t         jitter_sum; /**< Sum of wake-up delays */
+    int64_t         jitter_max; /**< The largest wake-up delay */
+} tx_scheduler;
+
+/** \typedef tx_pacer
+ * A token bucket of time on the air. Tokens are added at
+ * a share of the real time, and each packet takes its time
+ * on air, so that the load offered to the module stays
+ * below both the link capacity and a duty cycle limit.
+ */
+typedef struct {
+    double          share;      /**< Fraction of the time on the air */
+    int64_t         depth;      /**< Bucket size in ns on the air */
+    int64_t         tokens;     /**< Time on the air available */
+    struct timespec last;       /**< When tokens were last added */
+    // Counters of the current report.
+    struct timespec begin;      /**< Start of the report */
+    unsigned long   packets;    /**< Packets passed */
+    unsigned long   waits;      /**< Packets held for tokens */
+    int64_t         wait_sum;   /**< Sum of the time held */
+    int64_t         airtime;    /**< Sum of the time on the air */
+    long            bytes;      /**< Payload bytes passed */
+} tx_pacer;
+
+int64_t timespec_diff(const struct timespec *, const struct timespec *);
+int tx_scheduler_init(tx_scheduler *, int64_t);
+int64_t tx_scheduler_wait(tx_scheduler *);
+void tx_scheduler_report(tx_scheduler *);
+int tx_pacer_init(tx_pacer *, double, int64_t);
+int64_t tx_pacer_take(tx_pacer *, int64_t, int);
+void tx_pacer_report(tx_pacer *);
+
+#endif
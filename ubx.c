@@ -0,0 +1,509 @@
+/** \file ubx.c
+ *
+ * Function definitions for configuring Ublox NEO-7N GPS
+ * module through, and decoding, the UBX binary protocol.
+ *
+ * A UBX frame is laid out as follows, multi-byte values
+ * are little endian:
+ *
+ * -----------------------------------------------------------
+ * | 0xb5 | 0x62 | class | id | length (2) | payload | ck_a | ck_b |
+ * -----------------------------------------------------------
+ *
+ * The checksum is the 8-bit Fletcher algorithm over class,
+ * id, length and payload.
+ */
+
+#include <math.h>      // For floor().
+#include <time.h>      // For clock_gettime().
+#include "header.h"
+#include "ubx.h"
+
+/** \fn static void ubx_checksum(const unsigned char *p, int len, unsigned char ck[2])
+ *
+ * Accumulate the Fletcher checksum of a buffer into ck.
+ */
+static void ubx_checksum(const unsigned char *p, int len, unsigned char ck[2]) {
+    for (int i = 0; i < len; i++) {
+        ck[0] += p[i];
+        ck[1] += ck[0];
+    }
+}
+
+/** \fn static uint16_t get_u2(const unsigned char *p)
+ *
+ * Read a little endian unsigned 16-bit integer.
+ */
+static uint16_t get_u2(const unsigned char *p) {
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+/** \fn static int32_t get_i4(const unsigned char *p)
+ *
+ * Read a little endian signed 32-bit integer.
+ */
+static int32_t get_i4(const unsigned char *p) {
+    return (int32_t)(p[0] | (uint32_t)p[1] << 8 |
+        (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+/** \fn int ubx_frame(unsigned char *frame, int cls, int id, const unsigned char *payload, int len)
+ *
+ * Build a UBX frame.
+ * \param frame Where to build the frame, which needs
+ *        len + 8 bytes.
+ * \param cls The message class.
+ * \param id The message id.
+ * \param payload The payload, may be NULL if len is 0.
+ * \param len The payload length.
+ * \return Returns the frame length.
+ */
+int ubx_frame(unsigned char *frame, int cls, int id,
+    const unsigned char *payload, int len) {
+    unsigned char ck[2] = { 0, 0 };
+
+    frame[0] = UBX_SYNC1;
+    frame[1] = UBX_SYNC2;
+    frame[2] = cls;
+    frame[3] = id;
+    frame[4] = len & 0xff;
+    frame[5] = (len >> 8) & 0xff;
+    if (len > 0)
+        memcpy(frame + UBX_HEADER_SIZE, payload, len);
+    ubx_checksum(frame + 2, len + 4, ck);
+    frame[UBX_HEADER_SIZE + len] = ck[0];
+    frame[UBX_HEADER_SIZE + len + 1] = ck[1];
+
+    return UBX_HEADER_SIZE + len + 2;
+}
+
+/** \fn int ubx_send(int fd, int cls, int id, const unsigned char *payload, int len)
+ *
+ * Send a UBX message to the GPS module with a single write.
+ * \param fd The serial port where GPS module is mounted,
+ *        which should be open for writing.
+ * \return Returns 0 on success, -1 on error.
+ */
+int ubx_send(int fd, int cls, int id, const unsigned char *payload, int len) {
+    unsigned char frame[UBX_HEADER_SIZE + UBX_MAX_PAYLOAD + 2];
+    int n;
+
+    if (len < 0 || len > UBX_MAX_PAYLOAD)
+        return ERROR;
+    n = ubx_frame(frame, cls, id, payload, len);
+    if (write(fd, frame, n) != n)
+        return ERROR;
+    return OK;
+}
+
+/** \fn int ubx_set_msg_rate(int fd, int cls, int id, int rate)
+ *
+ * Set the output rate of a message on the port the
+ * command arrives at, through UBX-CFG-MSG.
+ * \param fd The serial port where GPS module is mounted.
+ * \param cls The message class.
+ * \param id The message id.
+ * \param rate Output once every rate navigation solutions,
+ *        0 to turn the message off.
+ * \return Returns 0 on success, -1 on error.
+ */
+int ubx_set_msg_rate(int fd, int cls, int id, int rate) {
+    unsigned char payload[3];
+
+    payload[0] = cls;
+    payload[1] = id;
+    payload[2] = rate;
+    return ubx_send(fd, UBX_CLASS_CFG, UBX_CFG_MSG, payload, 3);
+}
+
+/** \fn int ubx_enable(int fd)
+ *
+ * Switch the GPS module to UBX output: the default NMEA
+ * sentences GGA, GLL, GSA, GSV, RMC and VTG are turned off,
+ * and NAV-PVT is output on every solution. The settings
+ * are not saved, the module returns to NMEA after power
+ * down.
+ * \param fd The serial port where GPS module is mounted,
+ *        which should be open for reading and writing.
+ * \return Returns 0 on success, -1 on error.
+ */
+int ubx_enable(int fd) {
+    // NMEA message ids 0x00 to 0x05 are GGA, GLL, GSA,
+    // GSV, RMC and VTG.
+    for (int id = 0x00; id <= 0x05; id++)
+        if (ubx_set_msg_rate(fd, UBX_CLASS_NMEA, id, 0) < 0)
+            return ERROR;
+    return ubx_set_msg_rate(fd, UBX_CLASS_NAV, UBX_NAV_PVT, 1);
+}
+
+/** \fn int ubx_next_frame(ring_reader *r, ubx_msg *msg)
+ *
+ * Take the next UBX frame with a valid checksum out of the
+ * ring without reading the port. Bytes before the sync
+ * characters, e.g., NMEA sentences, are skipped.
+ * \param r The ring reader of the GPS serial port.
+ * \param msg Where to store the message, whose payload is
+ *        a slice of the ring valid until the next read.
+ * \return Returns 1 if a frame is taken, 0 if more input is
+ *         needed.
+ */
+int ubx_next_frame(ring_reader *r, ubx_msg *msg) {
+    const unsigned char *p;
+    unsigned char ck[2];
+    int len, n;
+
+    while ((p = (unsigned char *)ring_peek(r, UBX_HEADER_SIZE)) != NULL) {
+        // Hunt for the sync characters one byte at a time.
+        if (p[0] != UBX_SYNC1 || p[1] != UBX_SYNC2 ||
+            (len = get_u2(p + 4)) > UBX_MAX_PAYLOAD) {
+            ring_next_frame(r, 1);
+            continue;
+        }
+        n = UBX_HEADER_SIZE + len + 2;
+        if ((p = (unsigned char *)ring_peek(r, n)) == NULL)
+            return 0;
+
+        ck[0] = ck[1] = 0;
+        ubx_checksum(p + 2, len + 4, ck);
+        if (ck[0] != p[n - 2] || ck[1] != p[n - 1]) {
+            ring_next_frame(r, 1);
+            continue;
+        }
+
+        ring_next_frame(r, n);
+        msg->cls = p[2];
+        msg->id = p[3];
+        msg->len = len;
+        msg->payload = p + UBX_HEADER_SIZE;
+        return 1;
+    }
+    return 0;
+}
+
+/** \fn int read_ubx_frame(ring_reader *r, ubx_msg *msg)
+ *
+ * Read the next UBX frame with a valid checksum, filling
+ * the ring as needed.
+ * \param r The ring reader of the GPS serial port.
+ * \param msg Where to store the message.
+ * \return Returns -1 on error or end of file, 0 on success.
+ */
+int read_ubx_frame(ring_reader *r, ubx_msg *msg) {
+    while (ubx_next_frame(r, msg) == 0)
+        if (ring_fill(r) <= 0)
+            return ERROR;
+    return OK;
+}
+
+/** \fn int ubx_wait_ack(int fd, int cls, int id, int timeout)
+ *
+ * Wait for the acknowledgement of a CFG message. Other
+ * messages received meanwhile are dropped.
+ * \param fd The serial port where GPS module is mounted.
+ * \param cls The class of the acknowledged message.
+ * \param id The id of the acknowledged message.
+ * \param timeout The timeout in milliseconds.
+ * \return Returns 0 on ACK, -1 on NAK, error or timeout.
+ */
+int ubx_wait_ack(int fd, int cls, int id, int timeout) {
+    struct timespec now, deadline;
+    ring_reader *r;
+    ubx_msg msg;
+    int left;
+
+    if ((r = get_ring_reader(fd)) == NULL)
+        return ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+
+    while (1) {
+        while (ubx_next_frame(r, &msg))
+            if (msg.cls == UBX_CLASS_ACK && msg.len >= 2 &&
+                msg.payload[0] == cls && msg.payload[1] == id)
+                return msg.id == UBX_ACK_ACK ? OK : ERROR;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = (deadline.tv_sec - now.tv_sec) * 1000 +
+            (deadline.tv_nsec - now.tv_nsec) / 1000000;
+        if (left <= 0 || ring_fill_timeout(r, left) <= 0)
+            return ERROR;
+    }
+}
+
+/** \fn int ubx_set_rate(int fd, int hz)
+ *
+ * Set the navigation solution rate through UBX-CFG-RATE,
+ * and wait for its acknowledgement.
+ * \param fd The serial port where GPS module is mounted.
+ * \param hz The update rate, 1 to UBX_MAX_RATE.
+ * \return Returns 0 on success, -1 on error.
+ */
+int ubx_set_rate(int fd, int hz) {
+    unsigned char payload[6];
+    int ms;
+
+    if (hz < 1 || hz > UBX_MAX_RATE)
+        return ERROR;
+    ms = 1000 / hz;
+    // measRate in ms, navRate of 1 cycle, aligned to GPS time.
+    payload[0] = ms & 0xff;
+    payload[1] = (ms >> 8) & 0xff;
+    payload[2] = 1;
+    payload[3] = 0;
+    payload[4] = 1;
+    payload[5] = 0;
+    if (ubx_send(fd, UBX_CLASS_CFG, UBX_CFG_RATE, payload, 6) < 0)
+        return ERROR;
+    return ubx_wait_ack(fd, UBX_CLASS_CFG, UBX_CFG_RATE, UBX_ACK_TIMEOUT);
+}
+
+/** \fn int ubx_set_port(int fd, int baud)
+ *
+ * Set the baud rate of UART1 through UBX-CFG-PRT, with 8
+ * data bits, no parity, 1 stop bit, and both UBX and NMEA
+ * in and out. The module switches before acknowledging,
+ * so the acknowledgement is not waited for here.
+ * \param fd The serial port where GPS module is mounted.
+ * \param baud The new baud rate.
+ * \return Returns 0 on success, -1 on error.
+ */
+int ubx_set_port(int fd, int baud) {
+    unsigned char payload[20];
+
+    memset(payload, 0, sizeof(payload));
+    payload[0] = 1;                   // portID: UART1.
+    payload[4] = 0xc0;                // mode: 8 bits,
+    payload[5] = 0x08;                // no parity, 1 stop bit.
+    payload[8] = baud & 0xff;
+    payload[9] = (baud >> 8) & 0xff;
+    payload[10] = (baud >> 16) & 0xff;
+    payload[11] = (baud >> 24) & 0xff;
+    payload[12] = 0x03;               // inProtoMask: UBX, NMEA.
+    payload[14] = 0x03;               // outProtoMask: UBX, NMEA.
+    return ubx_send(fd, UBX_CLASS_CFG, UBX_CFG_PRT, payload, 20);
+}
+
+/** \fn int gps_setup(int fd, int baud, int hz)
+ *
+ * Move the GPS module to a new baud rate and update rate.
+ * The host port follows the module to the new baud rate,
+ * and the change is verified by the acknowledgement of
+ * the new update rate. On failure the host port goes back
+ * to its old baud rate.
+ * \param fd The serial port where GPS module is mounted,
+ *        which should be open for reading and writing.
+ * \param baud The new baud rate, e.g., 115200.
+ * \param hz The new update rate, 1 to UBX_MAX_RATE.
+ * \return Returns 0 on success, -1 on error.
+ */
+int gps_setup(int fd, int baud, int hz) {
+    struct termios buf;
+    speed_t old;
+
+    if (baud_to_speed(baud) == B0 || hz < 1 || hz > UBX_MAX_RATE)
+        return ERROR;
+    if (tcgetattr(fd, &buf) < 0)
+        return ERROR;
+    old = cfgetospeed(&buf);
+
+    // The baud rate is changed first, since the output of
+    // a higher update rate may not fit in the old one.
+    if (ubx_set_port(fd, baud) < 0)
+        return ERROR;
+    tcdrain(fd);
+    // Give the module time to switch.
+    usleep(100000);
+    if (change_speed(fd, baud) < 0)
+        return ERROR;
+
+    if (ubx_set_rate(fd, hz) < 0) {
+        print_msg("GPS does not answer at %d baud.", baud);
+        cfsetispeed(&buf, old);
+        cfsetospeed(&buf, old);
+        tcsetattr(fd, TCSANOW, &buf);
+        return ERROR;
+    }
+    return OK;
+}
+
+/** \fn int open_gps(const char *portname, int ubx, int baud, int hz)
+ *
+ * Open and configure the serial port of the GPS module.
+ * \param portname The serial port name, e.g., /dev/ttyUSB0.
+ * \param ubx Whether to switch the module to UBX output.
+ * \param baud The baud rate to move the module to, 0 to
+ *        leave it at 9600 bps.
+ * \param hz The update rate to set, 0 to leave it at 1 Hz.
+ * \return Returns -1 on failure, or the descriptor of the 
+ *         port on success.
+ */
+int open_gps(const char *portname, int ubx, int baud, int hz) {
+    int fd;
+
+    // Configuration is written to the port, otherwise
+    // the port is only read. Either way the port is fully
+    // raw, see RAW_IFLAGS, before any UBX frame, which is
+    // binary, is written or read; ubx_replay checks this.
+    if (!ubx && baud == 0 && hz == 0)
+        return raw_receive_init_nparity(portname);
+
+    if ((fd = raw_recv_send_init_nparity(portname)) < 0)
+        return ERROR;
+    if ((baud != 0 || hz != 0) &&
+        gps_setup(fd, baud ? baud : 9600, hz ? hz : 1) < 0) {
+        print_msg("fail to set up GPS port.");
+        close(fd);
+        return ERROR;
+    }
+    if (ubx && ubx_enable(fd) < 0) {
+        print_msg("fail to enable UBX output.");
+        close(fd);
+        return ERROR;
+    }
+    return fd;
+}
+
+/** \fn static double degree_to_nmea(int32_t deg_e7)
+ *
+ * Convert a coordinate in 1e-7 degrees to the unsigned
+ * ddmm.mmmm form used by NMEA sentences and gps_info.
+ */
+static double degree_to_nmea(int32_t deg_e7) {
+    double deg = fabs(deg_e7 / 1e7);
+    double whole = floor(deg);
+
+    return whole * 100 + (deg - whole) * 60;
+}
+
+/** \fn static void set_position(gps_info *pg, int32_t lon, int32_t lat, int32_t hmsl)
+ *
+ * Store a position in the gps_info in NMEA form.
+ * \param lon The longitude in 1e-7 degrees.
+ * \param lat The latitude in 1e-7 degrees.
+ * \param hmsl The height above mean sea level in mm.
+ */
+static void set_position(gps_info *pg, int32_t lon, int32_t lat, int32_t hmsl) {
+    pg->latitude = degree_to_nmea(lat);
+    pg->ns_hemisphere = lat < 0 ? 'S' : 'N';
+    pg->longitude = degree_to_nmea(lon);
+    pg->ew_hemisphere = lon < 0 ? 'W' : 'E';
+    pg->altitude = hmsl / 1000.0;
+}
+
+/** \fn static void decode_nav_pvt(const unsigned char *p, gps_info *pg)
+ *
+ * Decode a NAV-PVT payload, which carries everything the
+ * GGA, RMC, GSA and VTG sentences do.
+ */
+static void decode_nav_pvt(const unsigned char *p, gps_info *pg) {
+    int fix_type = p[20], fix_ok = p[21] & 0x01, diff = p[21] & 0x02;
+
+    // Time and date are only used when flagged valid.
+    if (p[11] & 0x02)
+        pg->utc_time = p[8] * 10000.0 + p[9] * 100.0 + p[10] +
+            get_i4(p + 16) / 1e9;
+    if (p[11] & 0x01)
+        pg->date = p[7] * 10000 + p[6] * 100 + get_u2(p + 4) % 100;
+
+    set_position(pg, get_i4(p + 24), get_i4(p + 28), get_i4(p + 36));
+
+    // Map the fix type to the GGA fix quality, and to the
+    // GSA fix type.
+    if (fix_ok && (fix_type == 2 || fix_type == 3 || fix_type == 4))
+        pg->fix_quality = diff ? 2 : 1;
+    else if (fix_ok && fix_type == 1)
+        pg->fix_quality = 6;
+    else
+        pg->fix_quality = 0;
+    pg->fix_type = (fix_type == 2 || fix_type == 3) ? fix_type : 1;
+    pg->status = fix_ok ? 'A' : 'V';
+    pg->satellites = p[23];
+    pg->pdop = get_u2(p + 76) / 100.0;
+    // gSpeed in mm/s, headMot in 1e-5 degrees.
+    pg->speed = get_i4(p + 60) * 0.0036;
+    pg->course = get_i4(p + 64) / 1e5;
+    pg->updated |= NMEA_BIT(NMEA_GGA) | NMEA_BIT(NMEA_RMC) |
+        NMEA_BIT(NMEA_GSA) | NMEA_BIT(NMEA_VTG);
+}
+
+/** \fn int decode_ubx(int cls, int id, const unsigned char *payload, int len, gps_info *pg)
+ *
+ * Decode a NAV-PVT or NAV-POSLLH message into the GPS
+ * information, by reading its fixed layout.
+ * \param cls The message class.
+ * \param id The message id.
+ * \param payload The payload.
+ * \param len The payload length.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns -1 for unsupported or short messages, or
+ *         the message id on success.
+ */
+int decode_ubx(int cls, int id, const unsigned char *payload, int len,
+    gps_info *pg) {
+    if (cls != UBX_CLASS_NAV)
+        return ERROR;
+
+    switch (id) {
+        case UBX_NAV_PVT:
+            if (len < UBX_NAV_PVT_SIZE)
+                return ERROR;
+            decode_nav_pvt(payload, pg);
+            break;
+        case UBX_NAV_POSLLH:
+            if (len < UBX_NAV_POSLLH_SIZE)
+                return ERROR;
+            set_position(pg, get_i4(payload + 4), get_i4(payload + 8),
+                get_i4(payload + 16));
+            pg->updated |= NMEA_BIT(NMEA_GGA);
+            break;
+        default:
+            return ERROR;
+    }
+    return id;
+}
+
+/** \fn int read_ubx_fix(int fd, gps_info *pg)
+ *
+ * Read UBX frames until a position is decoded, the
+ * counterpart of read_gps_fix() in UBX mode.
+ * \param fd The serial port where GPS module is mounted.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns -1 on error, or the id of the decoded
+ *         message on success.
+ */
+int read_ubx_fix(int fd, gps_info *pg) {
+    ring_reader *r;
+    ubx_msg msg;
+
+    if ((r = get_ring_reader(fd)) == NULL)
+        return ERROR;
+    while (1) {
+        if (read_ubx_frame(r, &msg) < 0)
+            return ERROR;
+        if (decode_ubx(msg.cls, msg.id, msg.payload, msg.len, pg) >= 0)
+            return msg.id;
+    }
+}
+
+/** \fn int poll_ubx_fix(ring_reader *r, gps_info *pg)
+ *
+ * Decode every whole UBX frame buffered in a ring reader,
+ * without reading the port, the counterpart of
+ * poll_gps_fix() in UBX mode.
+ * \param r The ring reader of the GPS port.
+ * \param pg The address of structure representing GPS
+ *           information.
+ * \return Returns the number of positions decoded.
+ */
+int poll_ubx_fix(ring_reader *r, gps_info *pg) {
+    ubx_msg msg;
+    int fixes = 0;
+
+    while (ubx_next_frame(r, &msg))
+        if (decode_ubx(msg.cls, msg.id, msg.payload, msg.len, pg) >= 0)
+            fixes++;
+    return fixes;
+}
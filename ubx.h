@@ -0,0 +1,69 @@
+/** \file ubx.h
+ *
+ * Macro definitions and function declarations for the
+ * UBX binary protocol of Ublox NEO-7N GPS module.
+ */
+
+#ifndef _UBX_H
+#define _UBX_H
+
+#include <stdint.h>          // For fixed width integers.
+#include "io_ops.h"          // Ring reader.
+#include "gps_analyzer.h"    // gps_info.
+
+#define UBX_SYNC1       0xb5  //< The first sync character.
+#define UBX_SYNC2       0x62  //< The second sync character.
+#define UBX_HEADER_SIZE 6     //< Sync characters, class, id and length.
+#define UBX_MAX_PAYLOAD (RING_MAX_LINE - UBX_HEADER_SIZE - 2) 
+                              /*< The longest payload read, so that
+                               * a whole frame is one ring slice.
+                               */
+
+#define UBX_CLASS_NAV   0x01  //< Navigation results.
+#define UBX_CLASS_ACK   0x05  //< Acknowledgements of CFG messages.
+#define UBX_CLASS_CFG   0x06  //< Configuration input.
+#define UBX_CLASS_NMEA  0xf0  //< Standard NMEA messages.
+
+#define UBX_NAV_POSLLH  0x02  //< Geodetic position.
+#define UBX_NAV_PVT     0x07  //< Navigation position velocity time.
+#define UBX_ACK_NAK     0x00  //< Message not acknowledged.
+#define UBX_ACK_ACK     0x01  //< Message acknowledged.
+#define UBX_CFG_PRT     0x00  //< Port configuration.
+#define UBX_CFG_MSG     0x01  //< Message rate.
+#define UBX_CFG_RATE    0x08  //< Navigation solution rate.
+
+#define UBX_NAV_POSLLH_SIZE 28 //< Payload length of NAV-POSLLH.
+#define UBX_NAV_PVT_SIZE    84 /*< Payload length of NAV-PVT on
+                                * protocol 14 (u-blox 7); later
+                                * versions append fields.
+                                */
+
+#define UBX_ACK_TIMEOUT 1000  //< Milliseconds to wait for an ACK.
+#define UBX_MAX_RATE    10    //< The highest NEO-7N update rate in Hz.
+
+/** \typedef ubx_msg
+ * A UBX message read from the GPS module.
+ */
+typedef struct {
+    int                  cls;      /**< Message class */
+    int                  id;       /**< Message id */
+    int                  len;      /**< Payload length */
+    const unsigned char *payload;  /**< Payload, a ring slice */
+} ubx_msg;
+
+int ubx_frame(unsigned char *, int, int, const unsigned char *, int);
+int ubx_send(int, int, int, const unsigned char *, int);
+int ubx_set_msg_rate(int, int, int, int);
+int ubx_enable(int);
+int ubx_next_frame(ring_reader *, ubx_msg *);
+int read_ubx_frame(ring_reader *, ubx_msg *);
+int ubx_wait_ack(int, int, int, int);
+int ubx_set_rate(int, int);
+int ubx_set_port(int, int);
+int gps_setup(int, int, int);
+int open_gps(const char *, int, int, int);
+int decode_ubx(int, int, const unsigned char *, int, gps_info *);
+int read_ubx_fix(int, gps_info *);
+int poll_ubx_fix(ring_reader *, gps_info *);
+
+#endif
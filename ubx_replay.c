@@ -0,0 +1,227 @@
+/** \file ubx_replay.c
+ *
+ * Replay of UBX frames through a pseudo terminal, as a
+ * check that the GPS port is set up fully raw before the
+ * module is switched to UBX.
+ *
+ * The slave side of the pty is left at its default
+ * termios, as a USB serial port is when it is plugged in,
+ * so that any input processing the host setup leaves on,
+ * e.g., CR to NL translation or VINTR, alters the frames.
+ * A thread plays the GPS module on the master side: it
+ * acknowledges the CFG-RATE message of gps_setup(), and
+ * then writes NAV-PVT and NAV-POSLLH frames in turn, whose
+ * positions hold bytes such as 0x03, 0x0a, 0x0d, 0x11,
+ * 0x13, 0x1a and 0x1c, and whose other bytes go through
+ * every value. The host opens the port with open_gps()
+ * and decodes every frame, which should match the frame
+ * written.
+ */
+
+#define _GNU_SOURCE        // For posix_openpt(), ptsname().
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include "ubx_replay.h"
+
+/** \fn static int replay_open_pty(int *master, char *name, int size)
+ *
+ * Open a pty, whose slave side is left at its default
+ * termios for the host to set up.
+ * \param master Where to store the master side.
+ * \param name Where to store the slave name.
+ * \param size The size of name.
+ * \return Returns -1 on error, 0 on success.
+ */
+static int replay_open_pty(int *master, char *name, int size) {
+    char *path;
+
+    if ((*master = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+        return ERROR;
+    if (grantpt(*master) < 0 || unlockpt(*master) < 0 ||
+        (path = ptsname(*master)) == NULL || (int)strlen(path) >= size)
+        return ERROR;
+    strcpy(name, path);
+    return OK;
+}
+
+/** \fn static int replay_payload(int i, unsigned char *payload, int *id)
+ *
+ * Build the payload of a frame replayed.
+ * \param i The index of the frame, stored in iTOW.
+ * \param payload Where to build the payload.
+ * \param id Where to store the message id.
+ * \return Returns the payload length.
+ */
+static int replay_payload(int i, unsigned char *payload, int *id) {
+    // Positions made of bytes a partly raw port alters.
+    static const unsigned char lon[4] = { 0x03, 0x0d, 0x00, 0x0a };
+    static const unsigned char lat[4] = { 0x1a, 0x1c, 0x11, 0x03 };
+    static const unsigned char hmsl[4] = { 0x0d, 0x0a, 0x13, 0x00 };
+    int len, at;
+
+    if (i % 2 == 0) {
+        *id = UBX_NAV_PVT;
+        len = UBX_NAV_PVT_SIZE;
+        at = 24;
+    } else {
+        *id = UBX_NAV_POSLLH;
+        len = UBX_NAV_POSLLH_SIZE;
+        at = 4;
+    }
+    // The other bytes go through every value.
+    for (int k = 0; k < len; k++)
+        payload[k] = (i * len + k) & 0xff;
+    payload[0] = i & 0xff;
+    payload[1] = (i >> 8) & 0xff;
+    payload[2] = (i >> 16) & 0xff;
+    payload[3] = 0;
+    memcpy(payload + at, lon, 4);
+    payload[at + 2] = i & 0xff;
+    memcpy(payload + at + 4, lat, 4);
+    // hMSL is at 36 in NAV-PVT, at 16 in NAV-POSLLH.
+    memcpy(payload + (*id == UBX_NAV_PVT ? 36 : 16), hmsl, 4);
+    return len;
+}
+
+/** \fn static int replay_write(ubx_module *m, const unsigned char *frame, int len)
+ *
+ * Write a frame on the master side, counting the byte
+ * values written.
+ * \return Returns -1 on error, 0 on success.
+ */
+static int replay_write(ubx_module *m, const unsigned char *frame, int len) {
+    if (write_all(m->fd, frame, len) < 0)
+        return ERROR;
+    for (int i = 0; i < len; i++)
+        m->values[frame[i]]++;
+    m->bytes += len;
+    return OK;
+}
+
+/** \fn static int replay_wait_rate(ubx_module *m)
+ *
+ * Read what the host writes until a CFG-RATE message,
+ * and acknowledge it. Other messages are ignored.
+ * \param m The module side.
+ * \return Returns -1 on error, 0 on success.
+ */
+static int replay_wait_rate(ubx_module *m) {
+    unsigned char buf[BUF_SIZE], ack[UBX_HEADER_SIZE + 2 + 2];
+    unsigned char acked[2] = { UBX_CLASS_CFG, UBX_CFG_RATE };
+    int got = 0, n;
+
+    while ((n = read(m->fd, buf + got, sizeof(buf) - got)) > 0) {
+        got += n;
+        for (int i = 0; i + 4 <= got; i++)
+            if (buf[i] == UBX_SYNC1 && buf[i + 1] == UBX_SYNC2 &&
+                buf[i + 2] == UBX_CLASS_CFG && buf[i + 3] == UBX_CFG_RATE) {
+                n = ubx_frame(ack, UBX_CLASS_ACK, UBX_ACK_ACK, acked, 2);
+                return replay_write(m, ack, n);
+            }
+        // Keep the tail, which may be the start of a frame.
+        if (got > 3) {
+            memmove(buf, buf + got - 3, 3);
+            got = 3;
+        }
+    }
+    return ERROR;
+}
+
+/** \fn static void *replay_module(void *arg)
+ *
+ * Play the GPS module on the master side of the pty.
+ * \param arg The ubx_module.
+ * \return Always returns NULL.
+ */
+static void *replay_module(void *arg) {
+    ubx_module *m = arg;
+    unsigned char payload[UBX_NAV_PVT_SIZE];
+    unsigned char frame[UBX_HEADER_SIZE + UBX_NAV_PVT_SIZE + 2];
+    int len, id;
+
+    if (replay_wait_rate(m) < 0)
+        return NULL;
+    m->acked = TRUE;
+    for (int i = 0; i < m->frames; i++) {
+        len = replay_payload(i, payload, &id);
+        len = ubx_frame(frame, UBX_CLASS_NAV, id, payload, len);
+        if (replay_write(m, frame, len) < 0)
+            break;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned char payload[UBX_NAV_PVT_SIZE];
+    char name[64];
+    pthread_t thread;
+    ring_reader *r;
+    ubx_msg msg;
+    gps_info got, want;
+    unsigned long decoded = 0, differ = 0;
+    int opt, fd, i, id, values = 0;
+
+    // Usage: ubx_replay [-n frames]
+    // -n: replay n frames, UBX_REPLAY_FRAMES by default.
+    module.frames = UBX_REPLAY_FRAMES;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                module.frames = atoi(optarg);
+                break;
+            default:
+                error_dump("argument misconfiguration.");
+        }
+    }
+    if (module.frames < 1 || module.frames >= 1 << 24)
+        error_dump("argument misconfiguration.");
+
+    if (replay_open_pty(&module.fd, name, sizeof(name)) < 0)
+        error_dump("fail to open a pty.");
+    if (pthread_create(&thread, NULL, replay_module, &module) != 0)
+        error_dump("fail to start the module.");
+    // The host sets the port up as the sender does.
+    if ((fd = open_gps(name, TRUE, 0, UBX_REPLAY_RATE)) < 0)
+        error_dump("fail to open the GPS port.");
+    if ((r = get_ring_reader(fd)) == NULL)
+        error_dump("fail");
+
+    // Frames are matched by their iTOW, so that a frame
+    // lost does not shift the others.
+    while (decoded + differ < (unsigned long)module.frames) {
+        if (!ubx_next_frame(r, &msg)) {
+            if (ring_fill_timeout(r, 1000) <= 0)
+                break;
+            continue;
+        }
+        if (msg.cls != UBX_CLASS_NAV || msg.len < 4)
+            continue;
+        i = msg.payload[0] | msg.payload[1] << 8 | msg.payload[2] << 16;
+        memset(&got, 0, sizeof(got));
+        memset(&want, 0, sizeof(want));
+        decode_ubx(msg.cls, msg.id, msg.payload, msg.len, &got);
+        replay_payload(i, payload, &id);
+        decode_ubx(UBX_CLASS_NAV, id, payload, msg.len, &want);
+        if (i < module.frames && msg.id == id &&
+            memcmp(msg.payload, payload, msg.len) == 0 &&
+            got.latitude == want.latitude &&
+            got.longitude == want.longitude &&
+            got.altitude == want.altitude)
+            decoded++;
+        else
+            differ++;
+    }
+    pthread_join(thread, NULL);
+    for (i = 0; i < 256; i++)
+        values += module.values[i] > 0;
+
+    print_msg("%s: %s, %lu bytes of %d byte values written, %d frames: "
+              "%lu decoded, %lu differ, %lu lost.",
+        name, module.acked ? "CFG-RATE acknowledged" : "no CFG-RATE",
+        module.bytes, values, module.frames, decoded, differ,
+        module.frames - decoded - differ);
+    close(fd);
+    return decoded == (unsigned long)module.frames ? OK : ERROR;
+}
@@ -0,0 +1,38 @@
+/** \file ubx_replay.h
+ *
+ * Function declarations for the replay of UBX frames
+ * through a pseudo terminal to the GPS port setup.
+ */
+
+#ifndef UBX_REPLAY_H
+#define UBX_REPLAY_H
+
+#include <pthread.h>                // The module side
+#include "header.h"
+#include "serial_port_config.h"     // Configure serial port
+#include "ubx.h"                    // UBX binary protocol
+
+#define UBX_REPLAY_FRAMES 1000      //< Frames replayed by default.
+#define UBX_REPLAY_RATE   5         //< The update rate set, in Hz.
+
+/** \typedef ubx_module
+ * The GPS module side of the pty.
+ */
+typedef struct {
+    int            fd;          /**< Master side of the pty */
+    int            frames;      /**< Frames to replay */
+    unsigned long  bytes;       /**< Bytes written */
+    int            values[256]; /**< Times each byte value was written */
+    int            acked;       /**< Whether CFG-RATE was acknowledged */
+} ubx_module;
+
+// The module side.
+static ubx_module module;
+
+static int replay_open_pty(int *, char *, int);
+static int replay_payload(int, unsigned char *, int *);
+static int replay_write(ubx_module *, const unsigned char *, int);
+static int replay_wait_rate(ubx_module *);
+static void *replay_module(void *);
+
+#endif